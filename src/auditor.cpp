@@ -0,0 +1,133 @@
+#include "common.h"
+#include "ipc.h"
+#include "logger.h"
+#include "scan.h"
+#include <sys/resource.h>
+#include <vector>
+#include <algorithm>
+
+SharedState* state;
+
+struct AuditSample {
+    int day;
+    Phase phase;
+    Location ship_location;
+    int ship_people;
+    int ship_bikes;
+    int ship_spaces;
+    int ship_count;
+    int bridge_count;
+    int riders_exited;
+    int riders_rejoined;
+};
+
+long samples, retries;
+int violations;
+
+// Reads the counters without any semaphore; retries while a writer is inside
+void take_sample(AuditSample& s) {
+    while (true) {
+        uint32_t seq = seq_read_begin(&state->state_seq);
+        s.day = state->day;
+        s.phase = state->phase;
+        s.ship_location = state->ship_location;
+        s.ship_people = state->ship_people;
+        s.ship_bikes = state->ship_bikes;
+        s.ship_spaces = state->ship_spaces;
+        s.ship_count = state->ship_count;
+        s.bridge_count = state->bridge_count;
+        s.riders_exited = state->riders_exited;
+        s.riders_rejoined = state->riders_rejoined;
+        if (!seq_read_retry(&state->state_seq, seq)) break;
+        retries++;
+    }
+    samples++;
+}
+
+void check(bool ok, const char* what, const AuditSample& s) {
+    if (ok) return;
+    violations++;
+    log_msg<LOG_ERROR>(state, "VIOLATION: %s (phase=%d ship=%d/%d people, %d/%d bikes, bridge=%d/%d)",
+            what, s.phase, s.ship_people, state->ship_capacity_people,
+            s.ship_bikes, state->ship_capacity_bikes, s.bridge_count, state->bridge_capacity);
+}
+
+void check_sample(const AuditSample& s, const AuditSample& prev) {
+    check(s.ship_people <= state->ship_capacity_people, "ship over N people", s);
+    check(s.ship_bikes <= state->ship_capacity_bikes, "ship over M bikes", s);
+    check(s.ship_spaces <= state->ship_capacity_spaces, "ship over SPACES", s);
+    check(s.ship_bikes <= s.ship_people, "more bikes than people on ship", s);
+    check(s.ship_count == s.ship_people, "ship roster does not match head count", s);
+    check(s.bridge_count >= 0 && s.bridge_count <= state->bridge_capacity, "bridge over K slots", s);
+    check(s.phase != PHASE_SAILING || s.bridge_count == 0, "sailing with people on bridge", s);
+    check(s.day != prev.day || s.riders_exited >= prev.riders_exited, "exit count went backwards", s);
+}
+
+// An exited rider stays exited until the next day unless it has legs left to ride:
+// a rejoin after the last leg would be an extra delivery.
+// The scan is not covered by the seqlock, so findings count only if the day did not roll meanwhile.
+void check_riders(std::vector<char>& exited, int day) {
+    std::vector<int> reverted;
+    for (int i = 0; i < state->passenger_count; i++) {
+        bool now = (__atomic_load_n(&state->rider_flags[i], __ATOMIC_RELAXED) & RIDER_STATE_MASK) == STATE_EXITED;
+        if (exited[i] && !now && state->passenger_legs[i] >= state->rider_trips) reverted.push_back(i);
+        exited[i] = now;
+    }
+    if (__atomic_load_n(&state->day, __ATOMIC_ACQUIRE) != day) return;
+    for (int pid : reverted) {
+        log_msg<LOG_ERROR>(state, "VIOLATION: P%d left the EXITED state", pid);
+        violations++;
+    }
+}
+
+void check_end_of_day(const AuditSample& s) {
+    const uint8_t* flags = state->rider_flags;
+    int n = state->passenger_count;
+    uint8_t where = RIDER_STATE_MASK | RIDER_WAWEL;
+    
+    int exited = scan_count(flags, n, RIDER_STATE_MASK, STATE_EXITED);
+    bool stranded = scan_next(flags, 0, n, RIDER_STATE_MASK, STATE_BRIDGE) < n ||
+                   scan_next(flags, 0, n, RIDER_STATE_MASK, STATE_SHIP) < n;
+    check(exited == s.riders_exited - s.riders_rejoined, "exit count does not match exited riders", s);
+    check(!stranded, "riders left on bridge or ship at end of day", s);
+    check(scan_count(flags, n, where, STATE_QUEUE) == pier_waiting(state, TYNIEC) &&
+          scan_count(flags, n, where, STATE_QUEUE | RIDER_WAWEL) == pier_waiting(state, WAWEL),
+          "queued riders do not match the pier queues", s);
+    check(s.ship_people == 0 && s.bridge_count == 0, "ship/bridge not empty at end of day", s);
+}
+
+int main() {
+    int shm_id = get_shm();
+    state = attach_shm(shm_id);
+    set_log_source(CAT_AUDITOR, "AUDITOR");
+    
+    struct timespec interval;
+    interval.tv_sec = state->audit_interval_ms / 1000;
+    interval.tv_nsec = (state->audit_interval_ms % 1000) * 1000000L;
+    
+    std::vector<char> exited(state->passenger_count, 0);
+    AuditSample prev = {};
+    AuditSample s;
+    
+    while (true) {
+        take_sample(s);
+        if (s.day != prev.day) std::fill(exited.begin(), exited.end(), 0);
+        check_sample(s, prev);
+        check_riders(exited, s.day);
+        prev = s;
+        if (s.phase == PHASE_END) break;
+        nanosleep(&interval, nullptr);
+    }
+    check_end_of_day(s);
+    
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    log_msg<LOG_INFO>(state, "Audit: %ld samples, %ld retries, %d violations, %.1f ms CPU",
+            samples, retries, violations,
+            ru.ru_utime.tv_sec * 1e3 + ru.ru_utime.tv_usec / 1e3 +
+            ru.ru_stime.tv_sec * 1e3 + ru.ru_stime.tv_usec / 1e3);
+    
+    flush_proc_stats(state);
+    detach_shm(state);
+    return violations > 0 ? 1 : 0;
+}
@@ -1,251 +1,335 @@
 #include "common.h"
 #include "ipc.h"
 #include "logger.h"
-#include <sys/time.h>
-#include <sched.h>
+#include "journal.h"
+#include "phase.h"
+#include "scan.h"
+#include "pier_queue.h"
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#define SAIL_REPORT_MS 5000
 
 SharedState* state;
-int sem_id, msg_id;
-bool signaled_for_ship[MAX_PASSENGERS];
+int sem_id;
+int epoll_fd, timer_fd;
+bool timer_fired;
+long day_start_ms;
 
 long get_time_ms() {
-    struct timeval tv;
-    gettimeofday(&tv, nullptr);
-    return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void init_events() {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epoll_fd == -1 || timer_fd == -1) {
+        perror("epoll/timerfd create");
+        exit(1);
+    }
+    
+    int fds[3] = {timer_fd, state->captain_efd, state->signal_efd};
+    for (int fd : fds) {
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            perror("epoll_ctl");
+            exit(1);
+        }
+    }
+}
+
+// Arms the one-shot phase deadline at an absolute CLOCK_MONOTONIC time; 0 disarms
+void arm_timer(long deadline_ms) {
+    struct itimerspec its = {};
+    its.it_value.tv_sec = deadline_ms / 1000;
+    its.it_value.tv_nsec = (deadline_ms % 1000) * 1000000;
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, nullptr) == -1) {
+        perror("timerfd_settime");
+        exit(1);
+    }
+    timer_fired = false;
 }
 
-int get_queue_size() {
-    return (state->ship_location == TYNIEC) ? state->queue_tyniec_size : state->queue_wawel_size;
+// Blocks until a passenger ack, a dispatcher signal, the phase deadline or timeout_ms
+void wait_events(int timeout_ms) {
+    struct epoll_event evs[3];
+    int n = epoll_wait(epoll_fd, evs, 3, timeout_ms);
+    if (n == -1 && errno != EINTR) {
+        perror("epoll_wait");
+        exit(1);
+    }
+    for (int i = 0; i < n; i++) {
+        if (evs[i].data.fd == timer_fd) {
+            timer_fired = true;
+            drain_eventfd(timer_fd);
+        } else {
+            drain_eventfd(evs[i].data.fd);
+        }
+    }
 }
 
-int get_queue_passenger(int idx) {
-    return (state->ship_location == TYNIEC) ? state->queue_tyniec[idx] : state->queue_wawel[idx];
+// First rider in line the bridge has room for, or -1
+template <typename Shape>
+int first_fitting_rider() {
+    return queue_peek(state, state->ship_location, bridge_fit_mask<Shape>(*state));
 }
 
-bool can_board_ship(int pid) {
-    bool has_bike = state->passenger_has_bike[pid];
-    if (state->ship_people >= state->ship_capacity_people) return false;
-    if (has_bike && state->ship_bikes >= state->ship_capacity_bikes) return false;
-    return true;
+void log_signal_latency(int signal, long sent_us) {
+    log_msg<LOG_INFO>(state, "Signal%d reaction latency: %ld us", signal, get_elapsed_us(state) - sent_us);
 }
 
-bool can_enter_bridge(int pid) {
-    bool has_bike = state->passenger_has_bike[pid];
-    int slots = has_bike ? 2 : 1;
-    return (state->bridge_count + slots <= state->bridge_capacity);
+void set_phase(Phase phase) {
+    sem_lock(sem_id, SEM_STATE);
+    sem_lock(sem_id, SEM_BRIDGE);
+    seq_write_begin(&state->state_seq);
+    state->phase = phase;
+    seq_write_end(&state->state_seq);
+    journal_event(state, EV_PHASE, -1, phase);
+    sem_unlock(sem_id, SEM_BRIDGE);
+    sem_unlock(sem_id, SEM_STATE);
 }
 
-void wait_for_ack(int expected_pid) {
-    int data;
+// Consumes rider events until `pid` reports `type`; other events are handed to on_event
+void wait_for_event(int pid, RiderEventType type, void (*on_event)(const RiderEvent&)) {
+    RiderEvent ev;
     while (true) {
-        recv_msg(msg_id, MSG_ACK, data, true);
-        if (data == expected_pid) return;
+        if (!ring_pop(&state->event_ring, ev)) {
+            wait_events(-1);
+            continue;
+        }
+        if (ev.pid == pid && ev.type == type) return;
+        if (on_event) on_event(ev);
     }
 }
 
+// A rider who just stepped on the bridge is sent on to the ship right away if it fits
+template <typename Shape>
+void on_loading_event(const RiderEvent& ev) {
+    if (ev.type == RIDER_ENTERED_BRIDGE && can_board_ship<Shape>(*state, rider_kind(state, ev.pid)))
+        futex_sem_post(&state->passenger_wake[ev.pid]);
+}
+
+template <typename Shape>
 void do_loading() {
     state->trip_num++;
-    log_msg(state, "CAPTAIN", "=== Trip %d: LOADING at %s ===", 
+    log_new_trip(state);
+    log_msg<LOG_INFO>(state, "=== Trip %d: LOADING at %s ===", 
             state->trip_num, location_name(state->ship_location));
-    log_msg(state, "CAPTAIN", "Loading... Ship: %d/%d people, %d/%d bikes",
+    log_msg<LOG_INFO>(state, "Loading... Ship: %d/%d people, %d/%d bikes",
             state->ship_people, state->ship_capacity_people,
             state->ship_bikes, state->ship_capacity_bikes);
     
-    state->phase = PHASE_LOADING;
     state->loading_done = false;
-    memset(signaled_for_ship, 0, sizeof(signaled_for_ship));
+    set_phase(PHASE_LOADING);
+    if (state->timeline_enabled) notify_eventfd(state->dispatcher_efd);
     
     long start_time = get_time_ms();
+    arm_timer(start_time + loading_deadline(*state));
+    int queue_sem = queue_lock(state->ship_location);
     
-    while (!state->loading_done) {
-        sem_lock(sem_id, SEM_MUTEX);
-        
-        if (state->signal2) {
-            log_msg(state, "CAPTAIN", "Signal2 received during loading - ending day");
-            state->day_ended = true;
-            state->loading_done = true;
-            sem_unlock(sem_id, SEM_MUTEX);
-            break;
+    // The rider last sent to the bridge; the next one waits until it has arrived,
+    // but the deadline, signals and ring events are still handled meanwhile
+    int in_flight = -1;
+    bool done = false;
+    while (!done) {
+        RiderEvent ev;
+        while (ring_pop(&state->event_ring, ev)) {
+            if (ev.pid == in_flight && ev.type == RIDER_ENTERED_BRIDGE) in_flight = -1;
+            on_loading_event<Shape>(ev);
         }
         
-        if (state->signal1) {
-            log_msg(state, "CAPTAIN", "Signal1 received - early departure");
-            state->loading_done = true;
-            sem_unlock(sem_id, SEM_MUTEX);
-            break;
-        }
-        
-        long elapsed = get_time_ms() - start_time;
-        if (elapsed >= state->t1) {
-            log_msg(state, "CAPTAIN", "Loading time T1 expired");
-            state->loading_done = true;
-            sem_unlock(sem_id, SEM_MUTEX);
-            break;
-        }
+        sem_lock(sem_id, SEM_STATE);
+        sem_lock(sem_id, SEM_SHIP);
         
-        if (state->ship_people >= state->ship_capacity_people) {
-            log_msg(state, "CAPTAIN", "Ship is full (%d/%d people)!", 
-                    state->ship_people, state->ship_capacity_people);
-            state->loading_done = true;
-            sem_unlock(sem_id, SEM_MUTEX);
-            break;
-        }
-        
-        for (int i = 0; i < state->bridge_size; i++) {
-            int pid = state->bridge_queue[i];
-            if (state->passenger_state[pid] == STATE_BRIDGE && 
-                !signaled_for_ship[pid] && can_board_ship(pid)) {
-                signaled_for_ship[pid] = true;
-                sem_unlock(sem_id, SEM_PASSENGER_BASE + pid);
+        LoadingOutcome outcome = loading_outcome<Shape>(*state, get_time_ms() - start_time);
+        if (outcome != LOAD_CONTINUE) {
+            if (outcome == LOAD_SIGNAL2) {
+                log_msg<LOG_INFO>(state, "Signal2 received during loading - ending day");
+                log_signal_latency(2, state->signal2_sent_us);
+                state->day_ended = true;
+            } else if (outcome == LOAD_SIGNAL1) {
+                log_msg<LOG_INFO>(state, "Signal1 received - early departure");
+                log_signal_latency(1, state->signal1_sent_us);
+                state->signal1 = false;
+            } else if (outcome == LOAD_T1_EXPIRED) {
+                log_msg<LOG_INFO>(state, state->departure_policy == DEPART_ADAPTIVE ?
+                        "Maximum dwell expired" : "Loading time T1 expired");
+            } else {
+                log_msg<LOG_INFO>(state, "Ship is full (%d/%d people)!", 
+                        state->ship_people, state->ship_capacity_people);
             }
+            done = true;
         }
-        
-        int next_queue = -1;
-        int queue_size = get_queue_size();
-        for (int i = 0; i < queue_size; i++) {
-            int pid = get_queue_passenger(i);
-            if (state->passenger_state[pid] == STATE_QUEUE &&
-                state->passenger_location[pid] == state->ship_location &&
-                can_enter_bridge(pid)) {
-                next_queue = pid;
-                break;
-            }
+        sem_unlock(sem_id, SEM_SHIP);
+        sem_unlock(sem_id, SEM_STATE);
+        if (done) break;
+        if (in_flight >= 0) {
+            wait_events(-1);
+            continue;
         }
         
+        sem_lock(sem_id, queue_sem);
+        int queue_size = pier_waiting(state, state->ship_location);
+        int next_queue = first_fitting_rider<Shape>();
+        sem_unlock(sem_id, queue_sem);
+        int on_bridge = __atomic_load_n(&state->bridge_size, __ATOMIC_ACQUIRE);
+        
         if (next_queue >= 0) {
-            sem_unlock(sem_id, SEM_MUTEX);
-            sem_unlock(sem_id, SEM_PASSENGER_BASE + next_queue);
-            wait_for_ack(next_queue);
-        } else {
-            bool any_waiting = false;
-            for (int i = 0; i < queue_size; i++) {
-                int pid = get_queue_passenger(i);
-                if (state->passenger_state[pid] == STATE_QUEUE &&
-                    state->passenger_location[pid] == state->ship_location) {
-                    any_waiting = true;
-                    break;
-                }
-            }
-            if (!any_waiting && state->bridge_size == 0) {
-                log_msg(state, "CAPTAIN", "No more passengers at %s", 
-                        location_name(state->ship_location));
-                state->loading_done = true;
+            futex_sem_post(&state->passenger_wake[next_queue]);
+            in_flight = next_queue;
+        } else if (state->departure_policy == DEPART_ADAPTIVE) {
+            // Rejoining riders wake the captain when they queue, so no arrival rate is assumed
+            long elapsed = get_time_ms() - start_time;
+            int across = pier_waiting(state, state->ship_location == TYNIEC ? WAWEL : TYNIEC);
+            if (adaptive_departure(*state, elapsed, queue_size + on_bridge, across, 0.0, 0.0)) {
+                log_msg<LOG_INFO>(state, "Adaptive departure after %ld ms: %d on board, %d waiting at %s",
+                        elapsed, state->ship_people, across,
+                        location_name(state->ship_location == TYNIEC ? WAWEL : TYNIEC));
+                done = true;
+            } else {
+                wait_events(queue_size + on_bridge == 0 ? (int)(state->min_dwell - elapsed) : -1);
             }
-            sem_unlock(sem_id, SEM_MUTEX);
-            sched_yield();
+        } else if (queue_size == 0 && on_bridge == 0) {
+            log_msg<LOG_INFO>(state, "No more passengers at %s", 
+                    location_name(state->ship_location));
+            done = true;
+        } else {
+            wait_events(-1);
         }
     }
     
-    state->signal1 = false;
-    log_msg(state, "CAPTAIN", "Loading complete: %d people, %d bikes on board",
+    // A rider still walking either reached the bridge before this or turns back
+    sem_lock(sem_id, SEM_BRIDGE);
+    state->loading_done = true;
+    sem_unlock(sem_id, SEM_BRIDGE);
+    arm_timer(0);
+    log_msg<LOG_INFO>(state, "Loading complete: %d people, %d bikes on board",
             state->ship_people, state->ship_bikes);
 }
 
 void do_bridge_clear() {
     if (state->bridge_size == 0) return;
     
-    log_msg(state, "CAPTAIN", "Clearing bridge (%d people still on bridge)...", state->bridge_size);
-    state->phase = PHASE_BRIDGE_CLEAR;
+    log_msg<LOG_INFO>(state, "Clearing bridge (%d people still on bridge)...", state->bridge_size);
+    set_phase(PHASE_BRIDGE_CLEAR);
     
-    while (state->bridge_size > 0) {
-        sem_lock(sem_id, SEM_MUTEX);
-        
-        if (state->bridge_size > 0) {
-            int pid = state->bridge_queue[state->bridge_size - 1];
-            sem_unlock(sem_id, SEM_MUTEX);
-            sem_unlock(sem_id, SEM_PASSENGER_BASE + pid);
-            wait_for_ack(pid);
-        } else {
-            sem_unlock(sem_id, SEM_MUTEX);
-        }
+    sem_lock(sem_id, SEM_BRIDGE);
+    int count = state->bridge_size;
+    int* riders = new int[count];
+    memcpy(riders, state->bridge_queue, count * sizeof(int));
+    sem_unlock(sem_id, SEM_BRIDGE);
+    
+    for (int i = count - 1; i >= 0; i--) {
+        futex_sem_post(&state->passenger_wake[riders[i]]);
+        wait_for_event(riders[i], RIDER_RETURNED_TO_QUEUE, nullptr);
     }
+    delete[] riders;
     
-    log_msg(state, "CAPTAIN", "Bridge cleared!");
+    log_msg<LOG_INFO>(state, "Bridge cleared!");
 }
 
 void do_sailing() {
     Location from = state->ship_location;
     Location to = (from == TYNIEC) ? WAWEL : TYNIEC;
     
-    log_msg(state, "CAPTAIN", "=== SAILING from %s to %s ===", 
+    log_msg<LOG_INFO>(state, "=== SAILING from %s to %s ===", 
             location_name(from), location_name(to));
     
-    state->phase = PHASE_SAILING;
+    set_phase(PHASE_SAILING);
     
-    int elapsed = 0;
-    int step = 5000;
-    while (elapsed < state->t2) {
-        int sleep_time = (state->t2 - elapsed < step) ? (state->t2 - elapsed) : step;
-        usleep(sleep_time * 1000);
-        elapsed += sleep_time;
-        log_msg(state, "CAPTAIN", "Sailing... %d/%d ms", elapsed, state->t2);
+    long start_time = get_time_ms();
+    arm_timer(start_time + state->t2);
+    int reported = 0;
+    bool signal2_seen = false;
+    
+    while (!timer_fired) {
+        int elapsed = (int)(get_time_ms() - start_time);
+        int next_report = reported + SAIL_REPORT_MS;
+        wait_events(next_report > elapsed ? next_report - elapsed : 0);
+        
+        elapsed = (int)(get_time_ms() - start_time);
+        if (!timer_fired && elapsed >= next_report) {
+            reported = next_report;
+            log_msg<LOG_DEBUG>(state, "Sailing... %d/%d ms", reported, state->t2);
+        }
         
-        sem_lock(sem_id, SEM_MUTEX);
-        if (state->signal2) {
-            log_msg(state, "CAPTAIN", "Signal2 received during sailing - will end after arrival");
+        sem_lock(sem_id, SEM_STATE);
+        if (state->signal2 && !signal2_seen) {
+            log_msg<LOG_INFO>(state, "Signal2 received during sailing - will end after arrival");
+            log_signal_latency(2, state->signal2_sent_us);
             state->day_ended = true;
+            signal2_seen = true;
         }
-        sem_unlock(sem_id, SEM_MUTEX);
+        sem_unlock(sem_id, SEM_STATE);
     }
+    log_msg<LOG_DEBUG>(state, "Sailing... %d/%d ms", state->t2, state->t2);
     
+    sem_lock(sem_id, SEM_BRIDGE);
+    seq_write_begin(&state->state_seq);
     state->ship_location = to;
-    log_msg(state, "CAPTAIN", "Arrived at %s!", location_name(to));
+    seq_write_end(&state->state_seq);
+    sem_unlock(sem_id, SEM_BRIDGE);
+    log_msg<LOG_INFO>(state, "Arrived at %s!", location_name(to));
+}
+
+int exited_count;
+
+// A rider who reached the bridge is sent ashore right away
+void on_unloading_event(const RiderEvent& ev) {
+    if (ev.type == RIDER_DISEMBARKED) futex_sem_post(&state->passenger_wake[ev.pid]);
+    else if (ev.type == RIDER_EXITED) exited_count++;
 }
 
+template <typename Shape>
 void do_unloading() {
-    log_msg(state, "CAPTAIN", "=== UNLOADING at %s (%d passengers) ===", 
+    log_msg<LOG_INFO>(state, "=== UNLOADING at %s (%d passengers) ===", 
             location_name(state->ship_location), state->ship_count);
     
-    state->phase = PHASE_UNLOADING;
-    bool signaled_for_exit[MAX_PASSENGERS] = {false};
+    set_phase(PHASE_UNLOADING);
     
-    while (state->ship_count > 0 || state->bridge_size > 0) {
-        sem_lock(sem_id, SEM_MUTEX);
-        
-        for (int i = 0; i < state->bridge_size; i++) {
-            int pid = state->bridge_queue[i];
-            if (state->passenger_state[pid] == STATE_BRIDGE && !signaled_for_exit[pid]) {
-                signaled_for_exit[pid] = true;
-                sem_unlock(sem_id, SEM_PASSENGER_BASE + pid);
-            }
-        }
+    sem_lock(sem_id, SEM_SHIP);
+    int count = state->ship_count;
+    int* riders = new int[count];
+    memcpy(riders, state->ship_passengers, count * sizeof(int));
+    sem_unlock(sem_id, SEM_SHIP);
+    
+    exited_count = 0;
+    int next = 0;
+    while (exited_count < count) {
+        RiderEvent ev;
+        while (ring_pop(&state->event_ring, ev)) on_unloading_event(ev);
         
-        if (state->ship_count > 0) {
-            int pid = state->ship_passengers[0];
-            bool has_bike = state->passenger_has_bike[pid];
-            int slots = has_bike ? 2 : 1;
-            
-            if (state->bridge_count + slots <= state->bridge_capacity) {
-                sem_unlock(sem_id, SEM_MUTEX);
-                sem_unlock(sem_id, SEM_PASSENGER_BASE + pid);
-                wait_for_ack(pid);
-                continue;
-            }
+        if (next < count && can_enter_bridge<Shape>(*state, rider_kind(state, riders[next]))) {
+            int pid = riders[next++];
+            futex_sem_post(&state->passenger_wake[pid]);
+            wait_for_event(pid, RIDER_DISEMBARKED, on_unloading_event);
+            on_unloading_event({RIDER_DISEMBARKED, pid});
+            continue;
         }
         
-        sem_unlock(sem_id, SEM_MUTEX);
-        sched_yield();
+        if (exited_count < count) wait_events(-1);
     }
+    delete[] riders;
     
-    log_msg(state, "CAPTAIN", "Unloading complete!");
+    log_msg<LOG_INFO>(state, "Unloading complete!");
 }
 
-int main() {
-    int shm_id = get_shm();
-    sem_id = get_sem();
-    msg_id = get_msgq();
-    state = attach_shm(shm_id);
-    
-    sem_lock(sem_id, SEM_CAPTAIN_READY);
+template <typename Shape>
+void run_day() {
+    day_start_ms = get_time_ms();
+    log_msg<LOG_INFO>(state, "=== DAY %d ===", state->day);
     
     while (state->trip_num < state->max_trips && !state->day_ended) {
-        do_loading();
+        do_loading<Shape>();
         
         if (state->day_ended) {
             do_bridge_clear();
             if (state->ship_count > 0) {
-                state->phase = PHASE_UNLOADING;
-                do_unloading();
+                do_unloading<Shape>();
             }
             break;
         }
@@ -253,23 +337,95 @@ int main() {
         do_bridge_clear();
         
         if (state->ship_count == 0) {
-            log_msg(state, "CAPTAIN", "No passengers on board - sailing empty to pick up passengers");
+            log_msg<LOG_INFO>(state, "No passengers on board - sailing empty to pick up passengers");
         }
         
         do_sailing();
-        do_unloading();
+        do_unloading<Shape>();
+        __atomic_fetch_add(&state->trips_completed, 1, __ATOMIC_RELAXED);
     }
+}
+
+void log_day_summary() {
+    log_msg<LOG_INFO>(state, "Day %d summary: %d trips, %d delivered, waiting %d at TYNIEC / %d at WAWEL, %ld ms",
+            state->day, state->trip_num, state->day_delivered,
+            pier_waiting(state, TYNIEC), pier_waiting(state, WAWEL), get_time_ms() - day_start_ms);
+}
+
+// Riders still waiting keep their place; everyone who got off joins the
+// back of the queue at the pier where they left the ship
+void start_next_day() {
+    sem_lock(sem_id, SEM_STATE);
+    sem_lock(sem_id, SEM_QUEUE_TYNIEC);
+    sem_lock(sem_id, SEM_QUEUE_WAWEL);
+    sem_lock(sem_id, SEM_BRIDGE);
+    sem_lock(sem_id, SEM_SHIP);
+    seq_write_begin(&state->state_seq);
+    
+    int n = state->passenger_count;
+    for (int i = scan_next(state->rider_flags, 0, n, RIDER_STATE_MASK, STATE_EXITED); i < n;
+         i = scan_next(state->rider_flags, i + 1, n, RIDER_STATE_MASK, STATE_EXITED)) {
+        set_rider_state(state, i, STATE_QUEUE);
+        queue_push(state, rider_location(state, i), i);
+    }
+    
+    state->day++;
+    state->trip_num = 0;
+    state->day_delivered = 0;
+    state->riders_exited = 0;
+    state->riders_rejoined = 0;
+    memset(state->passenger_legs, 0, state->passenger_count);
+    state->signal1 = false;
+    state->signal2 = false;
+    state->day_ended = false;
+    state->phase = PHASE_INIT;
+    
+    seq_write_end(&state->state_seq);
+    journal_event(state, EV_DAY, -1, state->day);
+    sem_unlock(sem_id, SEM_SHIP);
+    sem_unlock(sem_id, SEM_BRIDGE);
+    sem_unlock(sem_id, SEM_QUEUE_WAWEL);
+    sem_unlock(sem_id, SEM_QUEUE_TYNIEC);
+    sem_unlock(sem_id, SEM_STATE);
+}
+
+template <typename Shape>
+void run_season() {
+    while (true) {
+        run_day<Shape>();
+        log_day_summary();
+        if (state->day >= state->days) break;
+        start_next_day();
+    }
+}
+
+int main() {
+    int shm_id = get_shm();
+    sem_id = get_sem();
+    state = attach_shm(shm_id);
+    track_lock_stats(state->lock_stats);
+    set_log_source(CAT_CAPTAIN, "CAPTAIN");
+    init_events();
+    
+    sem_lock(sem_id, SEM_CAPTAIN_READY);
+    
+#ifdef TRAM_FIXED
+    if (state->fixed_shape) run_season<CompiledShape>();
+    else run_season<RuntimeShape>();
+#else
+    run_season<RuntimeShape>();
+#endif
     
-    log_msg(state, "CAPTAIN", "=== END OF DAY ===");
+    log_msg<LOG_INFO>(state, "=== END OF DAY ===");
     state->day_ended = true;
-    state->phase = PHASE_END;
+    set_phase(PHASE_END);
+    notify_eventfd(state->dispatcher_efd);
     
-    sem_lock(sem_id, SEM_MUTEX);
     for (int i = 0; i < state->passenger_count; i++) {
-        sem_unlock(sem_id, SEM_PASSENGER_BASE + i);
+        futex_sem_post(&state->passenger_wake[i]);
     }
-    sem_unlock(sem_id, SEM_MUTEX);
     
+    flush_proc_stats(state);
     detach_shm(state);
     return 0;
 }
@@ -13,15 +13,29 @@
 #include <cstdio>
 #include <cerrno>
 #include <ctime>
+#include <cstdint>
 
-#define MAX_PASSENGERS 10000
+// A fixed build (TRAM_FIXED_CONFIG) sizes the shared arrays to its config
+#ifdef TRAM_FIXED
+#include "fixed_shape.h"
+#define MAX_PASSENGERS TRAM_FIXED_RIDERS
+#define MAX_BRIDGE TRAM_FIXED_BRIDGE
+#else
+#define MAX_PASSENGERS 250000
 #define MAX_BRIDGE 10000
+#endif
+
+#define LOG_CHUNK_SIZE (4L << 20)
+#define LOG_MAP_SIZE (4L << 30)
+#define MAX_LOG_SEGMENTS 256
+#define MAX_LOG_MARKS 4096
 
 #define IPC_KEY_BASE 0x1234
 
 #define SHM_KEY (IPC_KEY_BASE + 1)
 #define SEM_KEY (IPC_KEY_BASE + 2)
 #define MSG_KEY (IPC_KEY_BASE + 3)
+#define TRACE_KEY (IPC_KEY_BASE + 4)
 
 enum Phase {
     PHASE_INIT = 0,
@@ -44,50 +58,203 @@ enum PassengerState {
     STATE_EXITED = 3
 };
 
+// Packed per-rider byte: bits 0-1 PassengerState, bit 2 location, bits 3-4 kind,
+// bits 5-6 ticket class. The scans finish with a scalar tail, so nothing reads past the last rider.
+#define RIDER_STATE_MASK 0x03
+#define RIDER_WAWEL 0x04
+#define RIDER_KIND_SHIFT 3
+#define RIDER_KIND_MASK 0x18
+#define RIDER_CLASS_SHIFT 5
+#define RIDER_CLASS_MASK 0x60
+
+// What a rider brings aboard; each kind has its own resource cost (kind_cost)
+#define RIDER_KINDS 4
+enum RiderKind {
+    KIND_WALKER = 0,
+    KIND_BIKE = 1,
+    KIND_STROLLER = 2,
+    KIND_WHEELCHAIR = 3
+};
+
+// Four 16-bit resource lanes in one word: bridge slots, people, bikes and
+// spaces (strollers, wheelchairs). A fit test over all lanes is one
+// subtraction (res_fits in phase.h), so more kinds cost nothing per check.
+#define RES_LANES 4
+enum ResLane {
+    LANE_BRIDGE = 0,
+    LANE_PEOPLE = 1,
+    LANE_BIKES = 2,
+    LANE_SPACES = 3
+};
+#define RES_LANE_MAX 0x3FFF
+#define RES_BRIDGE_LANE 0x000000000000FFFFULL
+#define RES_SHIP_LANES 0xFFFFFFFFFFFF0000ULL
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "resource lanes assume little-endian layout");
+
+inline uint64_t res_vec(int bridge, int people, int bikes, int spaces) {
+    return (uint64_t)bridge | (uint64_t)people << 16 | (uint64_t)bikes << 32 | (uint64_t)spaces << 48;
+}
+
+inline int res_lane(uint64_t v, int lane) {
+    return (int)(v >> (16 * lane) & 0xFFFF);
+}
+
+// Ticket classes, lowest priority first
+#define RIDER_CLASSES 3
+enum RiderClass {
+    CLASS_STANDARD = 0,
+    CLASS_PRIORITY = 1,
+    CLASS_SEASON = 2
+};
+
+// A pier queue is one binary min-heap per rider kind, keyed by
+// passenger_queue_key, so the captain can peek at whoever fits
+struct PierQueue {
+    int heap[RIDER_KINDS][MAX_PASSENGERS];
+    int size[RIDER_KINDS];
+    long next_seq;
+};
+
+// Lock order: STATE -> QUEUE_TYNIEC -> QUEUE_WAWEL -> BRIDGE -> SHIP.
+// STATE guards phase changes and signals, each QUEUE its pier queue,
+// BRIDGE the bridge, every write to the `used` lanes and to rider_flags,
+// SHIP the ship.
+// Phase changes also hold BRIDGE so boarding riders see a stable phase.
 enum SemIndex {
-    SEM_MUTEX = 0,
-    SEM_CAPTAIN_READY = 1,
-    SEM_PASSENGER_BASE = 2
+    SEM_STATE = 0,
+    SEM_QUEUE_TYNIEC = 1,
+    SEM_QUEUE_WAWEL = 2,
+    SEM_BRIDGE = 3,
+    SEM_SHIP = 4,
+    SEM_CAPTAIN_READY = 5,
+    SEM_COUNT = 6
 };
 
-struct MsgBuf {
-    long mtype;
-    int data;
+inline int queue_lock(Location loc) {
+    return loc == TYNIEC ? SEM_QUEUE_TYNIEC : SEM_QUEUE_WAWEL;
+}
+
+// Per-role totals for the end-of-day report, indexed by LogCategory
+#define ROLE_COUNT 6
+
+struct RoleStats {
+    long processes;
+    long utime_us;
+    long stime_us;
+    long vol_csw;
+    long invol_csw;
+    long semops;
+    long lock_wait_ns;
+    long futex_calls;
+    long eventfd_calls;
+    long log_lines;
 };
 
-#define MSG_ACK 1
-#define MSG_READY 2
+// Contended waits by decade, 10 us up to 1 s; the last bucket takes the rest
+#define LOCK_WAIT_BUCKETS 7
+
+struct LockStats {
+    long acquisitions;
+    long contended;
+    long wait_ns;
+    long wait_hist[LOCK_WAIT_BUCKETS];
+};
+
+enum RiderEventType {
+    RIDER_ENTERED_BRIDGE = 0,
+    RIDER_BOARDED = 1,
+    RIDER_DISEMBARKED = 2,
+    RIDER_EXITED = 3,
+    RIDER_RETURNED_TO_QUEUE = 4,
+    RIDER_REJOINED = 5
+};
+
+#define EVENT_RING_SIZE 4096
+
+// Slot turn is 2*lap while free and 2*lap+1 once filled, so a zeroed ring is empty
+struct RingSlot {
+    uint32_t turn;
+    int32_t type;
+    int32_t pid;
+};
+
+struct EventRing {
+    uint64_t head;
+    char pad[56];
+    uint64_t tail;
+    RingSlot slots[EVENT_RING_SIZE];
+};
+
+struct RiderEvent {
+    RiderEventType type;
+    int pid;
+};
+
+// Segment k of the log; writers reserve bytes with a fetch-add on offset
+struct LogSegment {
+    long offset;
+    long capacity;
+    long start_us;
+    int first_day;
+    int first_trip;
+    int rolled;
+};
+
+// Where each trip's log starts, for the sidecar index
+struct LogMark {
+    int day;
+    int trip;
+    int segment;
+    long offset;
+    long time_us;
+};
 
 struct SharedState {
     Phase phase;
     Location ship_location;
     int trip_num;
     int max_trips;
+    int day;
+    int days;
+    int day_delivered;
     
-    int ship_people;
-    int ship_bikes;
-    int ship_capacity_people;
-    int ship_capacity_bikes;
-    
-    int bridge_count;
-    int bridge_bike_slots;
-    int bridge_capacity;
+    // Lane views of the packed resource words; the lane order matches res_vec
+    union {
+        uint64_t used;
+        struct { uint16_t bridge_count, ship_people, ship_bikes, ship_spaces; };
+    };
+    union {
+        uint64_t capacity;
+        struct { uint16_t bridge_capacity, ship_capacity_people, ship_capacity_bikes, ship_capacity_spaces; };
+    };
+    uint64_t kind_cost[RIDER_KINDS];
     
     bool signal1;
     bool signal2;
     bool day_ended;
     bool loading_done;
+    bool timeline_enabled;
+    bool fixed_shape;
+    
+    int captain_efd;
+    int signal_efd;
+    int dispatcher_efd;
+    long signal1_sent_us;
+    long signal2_sent_us;
+    char control_file[256];
     
     int passenger_count;
-    int passenger_state[MAX_PASSENGERS];
-    int passenger_location[MAX_PASSENGERS];
-    bool passenger_has_bike[MAX_PASSENGERS];
+    uint8_t rider_flags[MAX_PASSENGERS];
     int passenger_queue_pos[MAX_PASSENGERS];
+    long passenger_queue_key[MAX_PASSENGERS];
+    uint8_t passenger_legs[MAX_PASSENGERS];
+    uint32_t passenger_wake[MAX_PASSENGERS];
     
-    int queue_tyniec[MAX_PASSENGERS];
-    int queue_tyniec_size;
-    int queue_wawel[MAX_PASSENGERS];
-    int queue_wawel_size;
+    // Indexed by Location; each guarded by its SEM_QUEUE lock
+    PierQueue piers[2];
+    int priority_skip;
+    int rider_trips;
+    int destination_dwell;
     
     int bridge_queue[MAX_BRIDGE];
     int bridge_size;
@@ -101,15 +268,90 @@ struct SharedState {
     int bridge_to_exit_time;
     int t1;
     int t2;
+    int departure_policy;
+    int min_dwell;
+    int max_dwell;
+    
+    long start_time_ns;
+    
+    // Seqlock over phase, location and ship/bridge counters; bumped under SEM_BRIDGE
+    uint32_t state_seq;
+    int riders_exited;
+    int riders_rejoined;
+    int audit_interval_ms;
     
-    long start_time_sec;
-    long start_time_usec;
+    // Totals over all days for the metrics exporter
+    long trips_completed;
+    long riders_delivered;
+    int metrics_port;
+    
+    LockStats lock_stats[SEM_COUNT];
+    RoleStats role_stats[ROLE_COUNT];
+    
+    EventRing event_ring;
     
     char log_file[256];
+    LogSegment log_segments[MAX_LOG_SEGMENTS];
+    int log_segment;
+    long log_segment_size;
+    int log_segment_trips;
+    LogMark log_marks[MAX_LOG_MARKS];
+    int log_mark_count;
+    long log_drops;
+    int log_level;
+    int log_categories;
+    bool log_stdout;
+    char journal_file[256];
+    bool journal_enabled;
+    long journal_count;
+    long journal_capacity;
+    long journal_drops;
+    bool trace_enabled;
     
     int next_board_index;
     int next_unboard_index;
     int passengers_to_unload;
 };
 
+inline PassengerState rider_state(const SharedState* s, int pid) {
+    return (PassengerState)(s->rider_flags[pid] & RIDER_STATE_MASK);
+}
+
+inline Location rider_location(const SharedState* s, int pid) {
+    return (s->rider_flags[pid] & RIDER_WAWEL) ? WAWEL : TYNIEC;
+}
+
+inline RiderKind rider_kind(const SharedState* s, int pid) {
+    return (RiderKind)((s->rider_flags[pid] & RIDER_KIND_MASK) >> RIDER_KIND_SHIFT);
+}
+
+inline const char* kind_name(int kind) {
+    static const char* names[RIDER_KINDS] = {"walker", "bike", "stroller", "wheelchair"};
+    return names[kind];
+}
+
+// Suffix after the rider's number in log lines and trace names (P12B)
+inline const char* kind_tag(int kind) {
+    static const char* tags[RIDER_KINDS] = {"", "B", "S", "W"};
+    return tags[kind];
+}
+
+inline RiderClass rider_class(const SharedState* s, int pid) {
+    return (RiderClass)((s->rider_flags[pid] & RIDER_CLASS_MASK) >> RIDER_CLASS_SHIFT);
+}
+
+inline int pier_waiting(const SharedState* s, Location loc) {
+    int n = 0;
+    for (int k = 0; k < RIDER_KINDS; k++) n += s->piers[loc].size[k];
+    return n;
+}
+
+inline void set_rider_state(SharedState* s, int pid, PassengerState st) {
+    s->rider_flags[pid] = (s->rider_flags[pid] & ~RIDER_STATE_MASK) | st;
+}
+
+inline void set_rider_location(SharedState* s, int pid, Location loc) {
+    s->rider_flags[pid] = (s->rider_flags[pid] & ~RIDER_WAWEL) | (loc == WAWEL ? RIDER_WAWEL : 0);
+}
+
 #endif
@@ -6,6 +6,52 @@
 #include <sys/resource.h>
 #include <cerrno>
 
+int* config_field(Config& cfg, const std::string& key) {
+    if (key == "N") return &cfg.N;
+    if (key == "M") return &cfg.M;
+    if (key == "K") return &cfg.K;
+    if (key == "SPACES") return &cfg.spaces;
+    if (key == "T1") return &cfg.T1;
+    if (key == "T2") return &cfg.T2;
+    if (key == "R") return &cfg.R;
+    if (key == "DEPARTURE") return &cfg.departure;
+    if (key == "MIN_DWELL") return &cfg.min_dwell;
+    if (key == "MAX_DWELL") return &cfg.max_dwell;
+    if (key == "DAYS") return &cfg.days;
+    if (key == "QUEUE_TO_BRIDGE_TIME") return &cfg.queue_to_bridge_time;
+    if (key == "BRIDGE_TO_SHIP_TIME") return &cfg.bridge_to_ship_time;
+    if (key == "SHIP_TO_BRIDGE_TIME") return &cfg.ship_to_bridge_time;
+    if (key == "BRIDGE_TO_EXIT_TIME") return &cfg.bridge_to_exit_time;
+    if (key == "TYNIEC_PEOPLE") return &cfg.tyniec_people;
+    if (key == "TYNIEC_BIKES") return &cfg.tyniec_bikes;
+    if (key == "WAWEL_PEOPLE") return &cfg.wawel_people;
+    if (key == "WAWEL_BIKES") return &cfg.wawel_bikes;
+    if (key == "TYNIEC_STROLLERS") return &cfg.tyniec_strollers;
+    if (key == "TYNIEC_WHEELCHAIRS") return &cfg.tyniec_wheelchairs;
+    if (key == "WAWEL_STROLLERS") return &cfg.wawel_strollers;
+    if (key == "WAWEL_WHEELCHAIRS") return &cfg.wawel_wheelchairs;
+    if (key == "BIKE_SLOTS") return &cfg.bike_slots;
+    if (key == "STROLLER_SLOTS") return &cfg.stroller_slots;
+    if (key == "STROLLER_SPACES") return &cfg.stroller_spaces;
+    if (key == "WHEELCHAIR_SLOTS") return &cfg.wheelchair_slots;
+    if (key == "WHEELCHAIR_SPACES") return &cfg.wheelchair_spaces;
+    if (key == "PRIORITY_PCT") return &cfg.priority_pct;
+    if (key == "SEASON_PCT") return &cfg.season_pct;
+    if (key == "PRIORITY_SKIP") return &cfg.priority_skip;
+    if (key == "RIDER_TRIPS") return &cfg.rider_trips;
+    if (key == "DESTINATION_DWELL") return &cfg.destination_dwell;
+    if (key == "JOURNAL") return &cfg.journal;
+    if (key == "AUDIT") return &cfg.audit;
+    if (key == "TRACE") return &cfg.trace;
+    if (key == "METRICS_PORT") return &cfg.metrics_port;
+    if (key == "LOG_LEVEL") return &cfg.log_level;
+    if (key == "LOG_STDOUT") return &cfg.log_stdout;
+    if (key == "LOG_CATEGORIES") return &cfg.log_categories;
+    if (key == "LOG_SEGMENT_MB") return &cfg.log_segment_mb;
+    if (key == "LOG_SEGMENT_TRIPS") return &cfg.log_segment_trips;
+    return nullptr;
+}
+
 bool load_config(const char* filename, Config& cfg) {
     std::ifstream file(filename);
     if (!file.is_open()) {
@@ -14,6 +60,17 @@ bool load_config(const char* filename, Config& cfg) {
     }
     
     cfg = {0};
+    cfg.days = 1;
+    cfg.priority_skip = 50;
+    cfg.rider_trips = 1;
+    cfg.bike_slots = 2;
+    cfg.stroller_slots = 2;
+    cfg.stroller_spaces = 1;
+    cfg.wheelchair_slots = 2;
+    cfg.wheelchair_spaces = 2;
+    cfg.log_level = 3;
+    cfg.log_stdout = 1;
+    cfg.log_categories = 0x3F;
     std::string line;
     
     while (std::getline(file, line)) {
@@ -42,79 +99,176 @@ bool load_config(const char* filename, Config& cfg) {
             return false;
         }
         
-        if (key == "N") cfg.N = val;
-        else if (key == "M") cfg.M = val;
-        else if (key == "K") cfg.K = val;
-        else if (key == "T1") cfg.T1 = val;
-        else if (key == "T2") cfg.T2 = val;
-        else if (key == "R") cfg.R = val;
-        else if (key == "QUEUE_TO_BRIDGE_TIME") cfg.queue_to_bridge_time = val;
-        else if (key == "BRIDGE_TO_SHIP_TIME") cfg.bridge_to_ship_time = val;
-        else if (key == "SHIP_TO_BRIDGE_TIME") cfg.ship_to_bridge_time = val;
-        else if (key == "BRIDGE_TO_EXIT_TIME") cfg.bridge_to_exit_time = val;
-        else if (key == "TYNIEC_PEOPLE") cfg.tyniec_people = val;
-        else if (key == "TYNIEC_BIKES") cfg.tyniec_bikes = val;
-        else if (key == "WAWEL_PEOPLE") cfg.wawel_people = val;
-        else if (key == "WAWEL_BIKES") cfg.wawel_bikes = val;
+        int* field = config_field(cfg, key);
+        if (field) *field = val;
     }
     
     return true;
 }
 
-bool validate_config(const Config& cfg) {
-    struct rlimit rl;
-    if (getrlimit(RLIMIT_NPROC, &rl) == -1) {
-        perror("getrlimit");
+// Checks that depend only on the config, shared with tools that never fork the simulation
+bool check_config(const Config& cfg, std::ostream& err) {
+    int total_passengers = total_riders(cfg);
+    if (total_passengers > MAX_PASSENGERS) {
+        err << "Error: Total passengers (" << total_passengers << ") cannot exceed " << MAX_PASSENGERS << std::endl;
         return false;
     }
     
-    int total_passengers = cfg.tyniec_people + cfg.tyniec_bikes + cfg.wawel_people + cfg.wawel_bikes;
-    int total_processes = total_passengers + 3;
+    if (cfg.N <= 0) { err << "Error: N must be positive" << std::endl; return false; }
+    if (cfg.N > MAX_PASSENGERS) { err << "Error: N cannot exceed " << MAX_PASSENGERS << std::endl; return false; }
+    if (cfg.M < 0) { err << "Error: M must be non-negative" << std::endl; return false; }
+    if (cfg.M >= cfg.N) { err << "Error: M must be less than N" << std::endl; return false; }
+    if (cfg.K <= 0) { err << "Error: K must be positive" << std::endl; return false; }
+    if (cfg.K > MAX_BRIDGE) { err << "Error: K cannot exceed " << MAX_BRIDGE << std::endl; return false; }
+    if (cfg.K >= cfg.N) { err << "Error: K must be less than N" << std::endl; return false; }
+    if (cfg.N > RES_LANE_MAX) { err << "Error: N cannot exceed " << RES_LANE_MAX << std::endl; return false; }
+    if (cfg.spaces < 0 || cfg.spaces > RES_LANE_MAX) { err << "Error: SPACES must be 0-" << RES_LANE_MAX << std::endl; return false; }
+    if (cfg.R <= 0) { err << "Error: R must be positive" << std::endl; return false; }
+    if (cfg.days <= 0) { err << "Error: DAYS must be positive" << std::endl; return false; }
+    if (cfg.T1 < 0) { err << "Error: T1 must be non-negative" << std::endl; return false; }
+    if (cfg.T2 < 0) { err << "Error: T2 must be non-negative" << std::endl; return false; }
+    if (cfg.departure != 0 && cfg.departure != 1) { err << "Error: DEPARTURE must be 0 (fixed) or 1 (adaptive)" << std::endl; return false; }
+    if (cfg.min_dwell < 0 || cfg.max_dwell < 0) { err << "Error: MIN_DWELL and MAX_DWELL must be non-negative" << std::endl; return false; }
+    if (cfg.min_dwell > effective_max_dwell(cfg)) { err << "Error: MIN_DWELL cannot exceed MAX_DWELL" << std::endl; return false; }
+    if (cfg.queue_to_bridge_time < 0) { err << "Error: QUEUE_TO_BRIDGE_TIME must be non-negative" << std::endl; return false; }
+    if (cfg.bridge_to_ship_time < 0) { err << "Error: BRIDGE_TO_SHIP_TIME must be non-negative" << std::endl; return false; }
+    if (cfg.ship_to_bridge_time < 0) { err << "Error: SHIP_TO_BRIDGE_TIME must be non-negative" << std::endl; return false; }
+    if (cfg.bridge_to_exit_time < 0) { err << "Error: BRIDGE_TO_EXIT_TIME must be non-negative" << std::endl; return false; }
+    if (cfg.tyniec_people < 0 || cfg.tyniec_bikes < 0) { err << "Error: Tyniec counts must be non-negative" << std::endl; return false; }
+    if (cfg.wawel_people < 0 || cfg.wawel_bikes < 0) { err << "Error: Wawel counts must be non-negative" << std::endl; return false; }
+    if (cfg.tyniec_strollers < 0 || cfg.tyniec_wheelchairs < 0 || cfg.wawel_strollers < 0 || cfg.wawel_wheelchairs < 0) { err << "Error: Stroller and wheelchair counts must be non-negative" << std::endl; return false; }
+    if (cfg.bike_slots < 1 || cfg.stroller_slots < 1 || cfg.wheelchair_slots < 1) { err << "Error: *_SLOTS must be positive" << std::endl; return false; }
+    if (cfg.stroller_spaces < 0 || cfg.wheelchair_spaces < 0 || cfg.stroller_spaces > 255 || cfg.wheelchair_spaces > 255) { err << "Error: *_SPACES must be 0-255" << std::endl; return false; }
+    for (int kind = 0; kind < RIDER_KINDS; kind++) {
+        if (pier_riders(cfg, TYNIEC, kind) + pier_riders(cfg, WAWEL, kind) == 0) continue;
+        uint64_t cost = kind_cost(cfg, kind);
+        if (res_lane(cost, LANE_BRIDGE) > cfg.K) { err << "Error: " << kind_name(kind) << " riders need more bridge slots than K" << std::endl; return false; }
+        if (res_lane(cost, LANE_SPACES) > cfg.spaces) { err << "Error: " << kind_name(kind) << " riders need more SPACES than the ship has" << std::endl; return false; }
+    }
+    if (cfg.priority_pct < 0 || cfg.season_pct < 0 || cfg.priority_pct + cfg.season_pct > 100) { err << "Error: PRIORITY_PCT and SEASON_PCT must be non-negative and sum to at most 100" << std::endl; return false; }
+    if (cfg.priority_skip < 0) { err << "Error: PRIORITY_SKIP must be non-negative" << std::endl; return false; }
+    if (cfg.rider_trips < 1 || cfg.rider_trips > 255) { err << "Error: RIDER_TRIPS must be 1-255" << std::endl; return false; }
+    if (cfg.destination_dwell < 0) { err << "Error: DESTINATION_DWELL must be non-negative" << std::endl; return false; }
+    if (cfg.log_level < 0 || cfg.log_level > 3) { err << "Error: LOG_LEVEL must be 0-3" << std::endl; return false; }
+    if (cfg.log_stdout != 0 && cfg.log_stdout != 1) { err << "Error: LOG_STDOUT must be 0 or 1" << std::endl; return false; }
+    if (cfg.log_categories < 0 || cfg.log_categories > 0x3F) { err << "Error: LOG_CATEGORIES must be a 6-bit mask" << std::endl; return false; }
+    if (cfg.log_segment_mb < 0 || cfg.log_segment_mb >= 4096) { err << "Error: LOG_SEGMENT_MB must be 0-4095" << std::endl; return false; }
+    if (cfg.log_segment_trips < 0) { err << "Error: LOG_SEGMENT_TRIPS must be non-negative" << std::endl; return false; }
+    if (cfg.journal != 0 && cfg.journal != 1) { err << "Error: JOURNAL must be 0 or 1" << std::endl; return false; }
+    if (cfg.trace != 0 && cfg.trace != 1) { err << "Error: TRACE must be 0 or 1" << std::endl; return false; }
+    if (cfg.audit < 0) { err << "Error: AUDIT must be non-negative" << std::endl; return false; }
+    if (cfg.metrics_port < 0 || cfg.metrics_port > 65535) { err << "Error: METRICS_PORT must be 0-65535" << std::endl; return false; }
+    if (cfg.tyniec_bikes > cfg.tyniec_people + cfg.tyniec_bikes) { err << "Error: Invalid Tyniec bike count" << std::endl; return false; }
     
-    if (total_passengers > MAX_PASSENGERS) {
-        std::cerr << "Error: Total passengers (" << total_passengers << ") cannot exceed " << MAX_PASSENGERS << std::endl;
+    return true;
+}
+
+bool validate_config(const Config& cfg) {
+    return check_config(cfg, std::cerr);
+}
+
+// Only main forks the riders, so only it has to fit them under RLIMIT_NPROC
+bool check_process_limit(const Config& cfg) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NPROC, &rl) == -1) {
+        perror("getrlimit");
         return false;
     }
     
+    int total_processes = total_riders(cfg) + 3;
     if (total_processes > (int)rl.rlim_cur / 2) {
         std::cerr << "Error: Too many passengers. Max allowed: " << (rl.rlim_cur / 2 - 3) << std::endl;
         return false;
     }
     
-    if (cfg.N <= 0) { std::cerr << "Error: N must be positive" << std::endl; return false; }
-    if (cfg.N > MAX_PASSENGERS) { std::cerr << "Error: N cannot exceed " << MAX_PASSENGERS << std::endl; return false; }
-    if (cfg.M < 0) { std::cerr << "Error: M must be non-negative" << std::endl; return false; }
-    if (cfg.M >= cfg.N) { std::cerr << "Error: M must be less than N" << std::endl; return false; }
-    if (cfg.K <= 0) { std::cerr << "Error: K must be positive" << std::endl; return false; }
-    if (cfg.K > MAX_BRIDGE) { std::cerr << "Error: K cannot exceed " << MAX_BRIDGE << std::endl; return false; }
-    if (cfg.K >= cfg.N) { std::cerr << "Error: K must be less than N" << std::endl; return false; }
-    if (cfg.R <= 0) { std::cerr << "Error: R must be positive" << std::endl; return false; }
-    if (cfg.T1 < 0) { std::cerr << "Error: T1 must be non-negative" << std::endl; return false; }
-    if (cfg.T2 < 0) { std::cerr << "Error: T2 must be non-negative" << std::endl; return false; }
-    if (cfg.queue_to_bridge_time < 0) { std::cerr << "Error: QUEUE_TO_BRIDGE_TIME must be non-negative" << std::endl; return false; }
-    if (cfg.bridge_to_ship_time < 0) { std::cerr << "Error: BRIDGE_TO_SHIP_TIME must be non-negative" << std::endl; return false; }
-    if (cfg.ship_to_bridge_time < 0) { std::cerr << "Error: SHIP_TO_BRIDGE_TIME must be non-negative" << std::endl; return false; }
-    if (cfg.bridge_to_exit_time < 0) { std::cerr << "Error: BRIDGE_TO_EXIT_TIME must be non-negative" << std::endl; return false; }
-    if (cfg.tyniec_people < 0 || cfg.tyniec_bikes < 0) { std::cerr << "Error: Tyniec counts must be non-negative" << std::endl; return false; }
-    if (cfg.wawel_people < 0 || cfg.wawel_bikes < 0) { std::cerr << "Error: Wawel counts must be non-negative" << std::endl; return false; }
-    if (cfg.tyniec_bikes > cfg.tyniec_people + cfg.tyniec_bikes) { std::cerr << "Error: Invalid Tyniec bike count" << std::endl; return false; }
-    
     return true;
 }
 
+int pier_riders(const Config& cfg, int loc, int kind) {
+    static const int Config::* counts[2][RIDER_KINDS] = {
+        {&Config::tyniec_people, &Config::tyniec_bikes, &Config::tyniec_strollers, &Config::tyniec_wheelchairs},
+        {&Config::wawel_people, &Config::wawel_bikes, &Config::wawel_strollers, &Config::wawel_wheelchairs}
+    };
+    return cfg.*counts[loc][kind];
+}
+
+int total_riders(const Config& cfg) {
+    int total = 0;
+    for (int loc = TYNIEC; loc <= WAWEL; loc++)
+        for (int kind = 0; kind < RIDER_KINDS; kind++) total += pier_riders(cfg, loc, kind);
+    return total;
+}
+
+// Bit k is set when either pier has riders of kind k
+unsigned rider_kinds(const Config& cfg) {
+    unsigned kinds = 0;
+    for (int kind = 0; kind < RIDER_KINDS; kind++)
+        if (pier_riders(cfg, TYNIEC, kind) + pier_riders(cfg, WAWEL, kind)) kinds |= 1u << kind;
+    return kinds;
+}
+
+// Bridge slots, people, bikes and spaces one rider of the kind takes up
+uint64_t kind_cost(const Config& cfg, int kind) {
+    switch (kind) {
+        case KIND_BIKE: return res_vec(cfg.bike_slots, 1, 1, 0);
+        case KIND_STROLLER: return res_vec(cfg.stroller_slots, 1, 0, cfg.stroller_spaces);
+        case KIND_WHEELCHAIR: return res_vec(cfg.wheelchair_slots, 1, 0, cfg.wheelchair_spaces);
+        default: return res_vec(1, 1, 0, 0);
+    }
+}
+
+// MAX_DWELL=0 keeps T1 as the upper bound
+int effective_max_dwell(const Config& cfg) {
+    return cfg.max_dwell > 0 ? cfg.max_dwell : cfg.T1;
+}
+
 void print_config(const Config& cfg) {
     std::cout << "\n=== Configuration ===" << std::endl;
     std::cout << "Ship capacity (people): N=" << cfg.N << std::endl;
     std::cout << "Ship capacity (bikes):  M=" << cfg.M << std::endl;
     std::cout << "Bridge capacity:        K=" << cfg.K << std::endl;
+    if (cfg.spaces)
+        std::cout << "Ship capacity (spaces): SPACES=" << cfg.spaces << std::endl;
     std::cout << "Loading time:           T1=" << cfg.T1 << " ms" << std::endl;
     std::cout << "Travel time:            T2=" << cfg.T2 << " ms" << std::endl;
     std::cout << "Max trips:              R=" << cfg.R << std::endl;
+    std::cout << "Days:                   " << cfg.days << std::endl;
+    if (cfg.departure)
+        std::cout << "Departure:              adaptive, dwell " << cfg.min_dwell << ".."
+                  << effective_max_dwell(cfg) << " ms" << std::endl;
+    else
+        std::cout << "Departure:              fixed T1" << std::endl;
     std::cout << "Transition times (ms):  queue->bridge=" << cfg.queue_to_bridge_time 
               << ", bridge->ship=" << cfg.bridge_to_ship_time
               << ", ship->bridge=" << cfg.ship_to_bridge_time
               << ", bridge->exit=" << cfg.bridge_to_exit_time << std::endl;
     std::cout << "Tyniec: " << cfg.tyniec_people << " people, " << cfg.tyniec_bikes << " with bikes" << std::endl;
     std::cout << "Wawel:  " << cfg.wawel_people << " people, " << cfg.wawel_bikes << " with bikes" << std::endl;
+    for (int kind = KIND_STROLLER; kind < RIDER_KINDS; kind++) {
+        int tyniec = pier_riders(cfg, TYNIEC, kind), wawel = pier_riders(cfg, WAWEL, kind);
+        if (!tyniec && !wawel) continue;
+        uint64_t cost = kind_cost(cfg, kind);
+        std::cout << "Riders with " << kind_name(kind) << "s: " << tyniec << " at Tyniec, " << wawel
+                  << " at Wawel, " << res_lane(cost, LANE_BRIDGE) << " bridge slots, " << res_lane(cost, LANE_SPACES) << " spaces each" << std::endl;
+    }
+    if (cfg.rider_trips > 1)
+        std::cout << "Rider trips:            " << cfg.rider_trips << " a day, "
+                  << cfg.destination_dwell << " ms at each destination" << std::endl;
+    if (cfg.priority_pct || cfg.season_pct)
+        std::cout << "Tickets:                " << cfg.priority_pct << "% priority, " << cfg.season_pct
+                  << "% season pass, skip " << cfg.priority_skip << " per class" << std::endl;
+    std::cout << "Logging:                level=" << cfg.log_level << ", categories=0x" << std::hex << cfg.log_categories
+              << std::dec << ", stdout=" << (cfg.log_stdout ? "on" : "off") << std::endl;
+    if (cfg.log_segment_mb || cfg.log_segment_trips)
+        std::cout << "Log segments:           every " << cfg.log_segment_mb << " MB / "
+                  << cfg.log_segment_trips << " trips (0 = off)" << std::endl;
+    std::cout << "Event journal:          " << (cfg.journal ? "on" : "off") << std::endl;
+    std::cout << "Trace export:           " << (cfg.trace ? "on" : "off") << std::endl;
+    std::cout << "Invariant auditor:      ";
+    if (cfg.audit) std::cout << "every " << cfg.audit << " ms" << std::endl;
+    else std::cout << "off" << std::endl;
+    std::cout << "Metrics endpoint:       ";
+    if (cfg.metrics_port) std::cout << "http://127.0.0.1:" << cfg.metrics_port << "/metrics" << std::endl;
+    else std::cout << "off" << std::endl;
     std::cout << "=====================\n" << std::endl;
 }
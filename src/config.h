@@ -2,14 +2,21 @@
 #define CONFIG_H
 
 #include <string>
+#include <ostream>
+#include <cstdint>
 
 struct Config {
     int N;
     int M;
     int K;
+    int spaces;
     int T1;
     int T2;
     int R;
+    int departure;
+    int min_dwell;
+    int max_dwell;
+    int days;
     int queue_to_bridge_time;
     int bridge_to_ship_time;
     int ship_to_bridge_time;
@@ -18,10 +25,41 @@ struct Config {
     int tyniec_bikes;
     int wawel_people;
     int wawel_bikes;
+    int tyniec_strollers;
+    int tyniec_wheelchairs;
+    int wawel_strollers;
+    int wawel_wheelchairs;
+    int bike_slots;
+    int stroller_slots;
+    int stroller_spaces;
+    int wheelchair_slots;
+    int wheelchair_spaces;
+    int priority_pct;
+    int season_pct;
+    int priority_skip;
+    int rider_trips;
+    int destination_dwell;
+    int journal;
+    int audit;
+    int trace;
+    int metrics_port;
+    int log_level;
+    int log_stdout;
+    int log_categories;
+    int log_segment_mb;
+    int log_segment_trips;
 };
 
+int* config_field(Config& cfg, const std::string& key);
 bool load_config(const char* filename, Config& cfg);
+bool check_config(const Config& cfg, std::ostream& err);
 bool validate_config(const Config& cfg);
+bool check_process_limit(const Config& cfg);
+int effective_max_dwell(const Config& cfg);
+int pier_riders(const Config& cfg, int loc, int kind);
+int total_riders(const Config& cfg);
+unsigned rider_kinds(const Config& cfg);
+uint64_t kind_cost(const Config& cfg, int kind);
 void print_config(const Config& cfg);
 
 #endif
@@ -1,60 +1,190 @@
 #include "common.h"
 #include "ipc.h"
 #include "logger.h"
+#include "journal.h"
+#include "timeline.h"
 #include <iostream>
 #include <termios.h>
 #include <poll.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <sys/timerfd.h>
 
 SharedState* state;
 int sem_id;
 
-int main() {
+// Returns false when the signal was already pending (or the day is over) and changed nothing
+bool handle_command(char c) {
+    if (c != '1' && c != '2') return false;
+    
+    bool sent = false;
+    sem_lock(sem_id, SEM_STATE);
+    
+    if (c == '1' && !state->signal1 && !state->day_ended) {
+        state->signal1_sent_us = get_elapsed_us(state);
+        state->signal1 = true;
+        log_msg<LOG_INFO>(state, "Signal1 sent - early departure");
+        journal_event(state, EV_SIGNAL1, -1, state->phase);
+        sent = true;
+    } else if (c == '2' && !state->signal2) {
+        state->signal2_sent_us = get_elapsed_us(state);
+        state->signal2 = true;
+        state->day_ended = true;
+        log_msg<LOG_INFO>(state, "Signal2 sent - ending day");
+        journal_event(state, EV_SIGNAL2, -1, state->phase);
+        sent = true;
+    }
+    
+    sem_unlock(sem_id, SEM_STATE);
+    // A repeated key would wake the captain for nothing, timed against the earlier send
+    if (sent) notify_eventfd(state->signal_efd);
+    return sent;
+}
+
+Timeline timeline;
+size_t next_timed;
+std::vector<int> trip_fired_day;
+int timer_fd = -1;
+struct termios saved_termios;
+bool tty;
+int fired, coalesced;
+long max_late_us;
+
+// Absolute CLOCK_MONOTONIC deadline of the next timed event; disarmed when none is left
+void arm_next_timed() {
+    struct itimerspec its = {};
+    if (next_timed < timeline.timed.size()) {
+        long ns = state->start_time_ns + timeline.timed[next_timed].at_us * 1000;
+        its.it_value.tv_sec = ns / 1000000000L;
+        its.it_value.tv_nsec = ns % 1000000000L;
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) its.it_value.tv_nsec = 1;
+    }
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, nullptr) == -1) {
+        perror("timerfd_settime");
+        exit(1);
+    }
+}
+
+void fire(char signal) {
+    if (handle_command(signal)) fired++;
+    else coalesced++;
+}
+
+void fire_due_timed() {
+    long now = get_elapsed_us(state);
+    while (next_timed < timeline.timed.size() && timeline.timed[next_timed].at_us <= now) {
+        const TimelineEvent& ev = timeline.timed[next_timed++];
+        max_late_us = std::max(max_late_us, now - ev.at_us);
+        log_msg<LOG_DEBUG>(state, "Timeline: signal%c planned at %ld us, %ld us late",
+                ev.signal, ev.at_us, now - ev.at_us);
+        fire(ev.signal);
+        now = get_elapsed_us(state);
+    }
+    arm_next_timed();
+}
+
+// The captain pokes dispatcher_efd when a loading phase starts while a timeline runs
+void fire_due_trips() {
+    if (__atomic_load_n(&state->phase, __ATOMIC_ACQUIRE) != PHASE_LOADING) return;
+    int day = state->day, trip = state->trip_num;
+    for (size_t i = 0; i < timeline.trips.size(); i++) {
+        const TimelineEvent& ev = timeline.trips[i];
+        if (ev.trip != trip || (ev.day && ev.day != day) || trip_fired_day[i] == day) continue;
+        trip_fired_day[i] = day;
+        log_msg<LOG_DEBUG>(state, "Timeline: signal%c at day %d trip %d", ev.signal, day, trip);
+        fire(ev.signal);
+    }
+}
+
+// main stops the run with SIGTERM and Ctrl-C reaches us directly; leave the terminal usable
+void restore_terminal(int sig) {
+    tcsetattr(STDIN_FILENO, TCSANOW, &saved_termios);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+int main(int argc, char* argv[]) {
     int shm_id = get_shm();
     sem_id = get_sem();
     state = attach_shm(shm_id);
+    track_lock_stats(state->lock_stats);
+    set_log_source(CAT_DISPATCHER, "DISPATCHER");
     
-    std::cout << "\n=== Dispatcher Controls ===" << std::endl;
-    std::cout << "Press '1' - Signal1: Early departure" << std::endl;
-    std::cout << "Press '2' - Signal2: End day" << std::endl;
-    std::cout << "===========================\n" << std::endl;
+    bool scripted = argc > 1;
+    if (scripted) {
+        if (!load_timeline(argv[1], timeline)) exit(1);
+        trip_fired_day.assign(timeline.trips.size(), 0);
+        timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (timer_fd == -1) {
+            perror("timerfd_create");
+            exit(1);
+        }
+        arm_next_timed();
+    } else {
+        std::cout << "\n=== Dispatcher Controls ===" << std::endl;
+        std::cout << "Press '1' - Signal1: Early departure" << std::endl;
+        std::cout << "Press '2' - Signal2: End day" << std::endl;
+        std::cout << "Or write 1/2 to " << state->control_file << std::endl;
+        std::cout << "===========================\n" << std::endl;
+    }
     
-    struct termios oldt, newt;
-    tcgetattr(STDIN_FILENO, &oldt);
-    newt = oldt;
-    newt.c_lflag &= ~(ICANON | ECHO);
-    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+    // A scripted run leaves the terminal alone
+    tty = !scripted && isatty(STDIN_FILENO);
+    if (tty) {
+        tcgetattr(STDIN_FILENO, &saved_termios);
+        struct termios raw = saved_termios;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        signal(SIGINT, restore_terminal);
+        signal(SIGTERM, restore_terminal);
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    }
     
-    struct pollfd pfd;
-    pfd.fd = STDIN_FILENO;
-    pfd.events = POLLIN;
+    // Holding our own write end keeps the FIFO from reporting POLLHUP between writers
+    int ctl_fd = open(state->control_file, O_RDONLY | O_NONBLOCK);
+    int ctl_keepalive = open(state->control_file, O_WRONLY | O_NONBLOCK);
+    if (ctl_fd == -1 || ctl_keepalive == -1) perror("open control fifo");
     
-    while (true) {
-        if (state->phase == PHASE_END || state->day_ended) break;
-        
-        int ret = poll(&pfd, 1, 100);
-        if (ret > 0 && (pfd.revents & POLLIN)) {
-            char c;
-            if (read(STDIN_FILENO, &c, 1) == 1) {
-                sem_lock(sem_id, SEM_MUTEX);
-                
-                if (c == '1' && !state->signal1) {
-                    state->signal1 = true;
-                    log_msg(state, "DISPATCHER", "Signal1 sent - early departure");
-                } else if (c == '2' && !state->signal2) {
-                    state->signal2 = true;
-                    state->day_ended = true;
-                    log_msg(state, "DISPATCHER", "Signal2 sent - ending day");
-                }
-                
-                sem_unlock(sem_id, SEM_MUTEX);
-            }
+    struct pollfd pfds[4];
+    pfds[0] = {state->dispatcher_efd, POLLIN, 0};
+    pfds[1] = {scripted ? -1 : STDIN_FILENO, POLLIN, 0};
+    pfds[2] = {ctl_fd, POLLIN, 0};
+    pfds[3] = {timer_fd, POLLIN, 0};
+    
+    while (__atomic_load_n(&state->phase, __ATOMIC_ACQUIRE) != PHASE_END) {
+        int ret = poll(pfds, 4, -1);
+        if (ret == -1) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        if (pfds[0].revents & POLLIN) {
+            drain_eventfd(pfds[0].fd);
+            if (scripted) fire_due_trips();
+        }
+        if (pfds[3].revents & POLLIN) {
+            drain_eventfd(pfds[3].fd);
+            fire_due_timed();
         }
         
-        if (state->phase == PHASE_END || state->day_ended) break;
+        for (int i = 1; i < 3; i++) {
+            if (!(pfds[i].revents & (POLLIN | POLLHUP))) continue;
+            char buf[64];
+            ssize_t n = read(pfds[i].fd, buf, sizeof(buf));
+            if (n == 0 && i == 1) pfds[i].fd = -1;
+            for (ssize_t j = 0; j < n; j++) handle_command(buf[j]);
+        }
     }
     
-    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+    if (scripted) {
+        log_msg<LOG_INFO>(state, "Timeline: %d signals fired, %d coalesced, %zu never reached, max lateness %ld us",
+                fired, coalesced, timeline.timed.size() - next_timed, max_late_us);
+        close(timer_fd);
+    }
+    if (tty) tcsetattr(STDIN_FILENO, TCSANOW, &saved_termios);
+    if (ctl_fd != -1) close(ctl_fd);
+    if (ctl_keepalive != -1) close(ctl_keepalive);
     
+    flush_proc_stats(state);
     detach_shm(state);
     return 0;
 }
@@ -0,0 +1,195 @@
+#include "common.h"
+#include "ipc.h"
+#include "logger.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <cstdarg>
+#include <cstring>
+#include <string>
+
+SharedState* state;
+long scrapes;
+
+struct Occupancy {
+    int day;
+    Phase phase;
+    int trip_num;
+    int bridge_count;
+    int ship_people;
+    int ship_bikes;
+    int ship_spaces;
+};
+
+// Same lock-free read as the auditor: the exporter never opens the semaphore set
+void read_occupancy(Occupancy& o) {
+    while (true) {
+        uint32_t seq = seq_read_begin(&state->state_seq);
+        o.day = state->day;
+        o.phase = state->phase;
+        o.trip_num = state->trip_num;
+        o.bridge_count = state->bridge_count;
+        o.ship_people = state->ship_people;
+        o.ship_bikes = state->ship_bikes;
+        o.ship_spaces = state->ship_spaces;
+        if (!seq_read_retry(&state->state_seq, seq)) break;
+    }
+}
+
+void emit(std::string& out, const char* format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    out += line;
+}
+
+long load(const long* v) {
+    return __atomic_load_n(v, __ATOMIC_RELAXED);
+}
+
+std::string render_metrics() {
+    static const char* bounds[LOCK_WAIT_BUCKETS] = {"0.00001", "0.0001", "0.001", "0.01", "0.1", "1", "+Inf"};
+    Occupancy o;
+    read_occupancy(o);
+    std::string out;
+    
+    emit(out, "# TYPE tram_trips counter\n# HELP tram_trips Trips sailed and unloaded.\n");
+    emit(out, "tram_trips_total %ld\n", load(&state->trips_completed));
+    emit(out, "# TYPE tram_riders_delivered counter\n# HELP tram_riders_delivered Riders carried to the other pier.\n");
+    emit(out, "tram_riders_delivered_total %ld\n", load(&state->riders_delivered));
+    emit(out, "# TYPE tram_day gauge\ntram_day %d\n", o.day);
+    emit(out, "# TYPE tram_trip gauge\n# HELP tram_trip Trip number within the current day.\ntram_trip %d\n", o.trip_num);
+    emit(out, "# TYPE tram_phase gauge\ntram_phase %d\n", o.phase);
+    
+    emit(out, "# TYPE tram_queue_depth gauge\n# HELP tram_queue_depth Riders waiting at a pier.\n");
+    for (int loc = TYNIEC; loc <= WAWEL; loc++)
+        emit(out, "tram_queue_depth{pier=\"%s\"} %d\n", location_name((Location)loc), pier_waiting(state, (Location)loc));
+    
+    emit(out, "# TYPE tram_bridge_occupancy gauge\ntram_bridge_occupancy %d\n", o.bridge_count);
+    emit(out, "# TYPE tram_bridge_capacity gauge\ntram_bridge_capacity %d\n", state->bridge_capacity);
+    emit(out, "# TYPE tram_ship_occupancy gauge\n");
+    emit(out, "tram_ship_occupancy{resource=\"people\"} %d\n", o.ship_people);
+    emit(out, "tram_ship_occupancy{resource=\"bikes\"} %d\n", o.ship_bikes);
+    emit(out, "tram_ship_occupancy{resource=\"spaces\"} %d\n", o.ship_spaces);
+    emit(out, "# TYPE tram_ship_capacity gauge\n");
+    emit(out, "tram_ship_capacity{resource=\"people\"} %d\n", state->ship_capacity_people);
+    emit(out, "tram_ship_capacity{resource=\"bikes\"} %d\n", state->ship_capacity_bikes);
+    emit(out, "tram_ship_capacity{resource=\"spaces\"} %d\n", state->ship_capacity_spaces);
+    
+    emit(out, "# TYPE tram_lock_acquisitions counter\n");
+    for (int i = SEM_STATE; i <= SEM_SHIP; i++)
+        emit(out, "tram_lock_acquisitions_total{lock=\"%s\"} %ld\n", sem_name(i), load(&state->lock_stats[i].acquisitions));
+    
+    // The count is summed from the buckets read here, so a scrape racing a writer stays self-consistent
+    emit(out, "# TYPE tram_lock_wait_seconds histogram\n# HELP tram_lock_wait_seconds Time blocked on contended semaphores.\n");
+    for (int i = SEM_STATE; i <= SEM_SHIP; i++) {
+        const LockStats& ls = state->lock_stats[i];
+        long count = 0;
+        for (int b = 0; b < LOCK_WAIT_BUCKETS; b++) {
+            count += load(&ls.wait_hist[b]);
+            emit(out, "tram_lock_wait_seconds_bucket{lock=\"%s\",le=\"%s\"} %ld\n", sem_name(i), bounds[b], count);
+        }
+        emit(out, "tram_lock_wait_seconds_count{lock=\"%s\"} %ld\n", sem_name(i), count);
+        emit(out, "tram_lock_wait_seconds_sum{lock=\"%s\"} %.9f\n", sem_name(i), load(&ls.wait_ns) / 1e9);
+    }
+    
+    emit(out, "# TYPE tram_log_drops counter\n# HELP tram_log_drops Log lines lost to a full log buffer.\n");
+    emit(out, "tram_log_drops_total %ld\n", load(&state->log_drops));
+    emit(out, "# EOF\n");
+    return out;
+}
+
+void write_all(int fd, const std::string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) return;
+        done += n;
+    }
+}
+
+// One request per connection; anything but GET /metrics gets a 404
+void serve(int fd) {
+    char req[1024];
+    size_t len = 0;
+    while (len < sizeof(req) - 1) {
+        ssize_t n = read(fd, req + len, sizeof(req) - 1 - len);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len += n;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n")) break;
+    }
+    req[len] = '\0';
+    
+    if (strncmp(req, "GET /metrics ", 13) != 0 && strncmp(req, "GET /metrics?", 13) != 0) {
+        write_all(fd, "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        return;
+    }
+    std::string body = render_metrics();
+    std::string head = "HTTP/1.0 200 OK\r\n"
+                       "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                       "Content-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+    write_all(fd, head + body);
+    scrapes++;
+}
+
+int open_listener(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(fd, 16) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main() {
+    int shm_id = get_shm();
+    state = attach_shm(shm_id);
+    set_log_source(CAT_EXPORTER, "EXPORTER");
+    
+    int listen_fd = open_listener(state->metrics_port);
+    if (listen_fd == -1) {
+        log_msg<LOG_ERROR>(state, "Cannot listen on 127.0.0.1:%d: %s", state->metrics_port, strerror(errno));
+        detach_shm(state);
+        return 1;
+    }
+    log_msg<LOG_INFO>(state, "Serving http://127.0.0.1:%d/metrics", state->metrics_port);
+    
+    // A slow client must not stall the loop that notices the end of the simulation
+    struct timeval io_timeout = {0, 500000};
+    struct pollfd pfd = {listen_fd, POLLIN, 0};
+    while (__atomic_load_n(&state->phase, __ATOMIC_ACQUIRE) != PHASE_END) {
+        int ret = poll(&pfd, 1, 200);
+        if (ret == -1) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        if (ret == 0) continue;
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd == -1) continue;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &io_timeout, sizeof(io_timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &io_timeout, sizeof(io_timeout));
+        serve(fd);
+        close(fd);
+    }
+    close(listen_fd);
+    
+    log_msg<LOG_INFO>(state, "Exporter: %ld scrapes served", scrapes);
+    flush_proc_stats(state);
+    detach_shm(state);
+    return 0;
+}
@@ -1,6 +1,12 @@
 #include "ipc.h"
+#include "logger.h"
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <sched.h>
 #include <cstdio>
 #include <cstdlib>
+#include <cstdint>
 
 int create_shm(size_t size) {
     int shm_id = shmget(SHM_KEY, size, IPC_CREAT | IPC_EXCL | 0600);
@@ -59,17 +65,75 @@ int get_sem() {
     return sem_id;
 }
 
+static LockStats* lock_stats = nullptr;
+static RoleStats proc_stats;
+
+void track_lock_stats(LockStats* stats) {
+    lock_stats = stats;
+}
+
+// Adds this process's syscall counters to its role's totals; called once before exit
+void flush_proc_stats(SharedState* state) {
+    RoleStats& r = state->role_stats[log_category];
+    __atomic_fetch_add(&r.semops, proc_stats.semops, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&r.lock_wait_ns, proc_stats.lock_wait_ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&r.futex_calls, proc_stats.futex_calls, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&r.eventfd_calls, proc_stats.eventfd_calls, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&r.log_lines, log_line_count(), __ATOMIC_RELAXED);
+}
+
+const char* sem_name(int sem_num) {
+    switch (sem_num) {
+        case SEM_STATE: return "STATE";
+        case SEM_QUEUE_TYNIEC: return "QUEUE_TYNIEC";
+        case SEM_QUEUE_WAWEL: return "QUEUE_WAWEL";
+        case SEM_BRIDGE: return "BRIDGE";
+        case SEM_SHIP: return "SHIP";
+        case SEM_CAPTAIN_READY: return "CAPTAIN_READY";
+        default: return "?";
+    }
+}
+
+// Tries without blocking first so contention and wait time are only measured when we really block
 void sem_lock(int sem_id, int sem_num) {
-    struct sembuf op = {(unsigned short)sem_num, -1, 0};
+    struct sembuf op = {(unsigned short)sem_num, -1, IPC_NOWAIT};
+    proc_stats.semops++;
+    if (semop(sem_id, &op, 1) == 0) {
+        if (lock_stats) __atomic_fetch_add(&lock_stats[sem_num].acquisitions, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    if (errno != EAGAIN && errno != EINTR) {
+        perror("semop lock");
+        exit(1);
+    }
+    
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    op.sem_flg = 0;
+    proc_stats.semops++;
     while (semop(sem_id, &op, 1) == -1) {
         if (errno == EINTR) continue;
         perror("semop lock");
         exit(1);
     }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    long wait_ns = (t1.tv_sec - t0.tv_sec) * 1000000000L + (t1.tv_nsec - t0.tv_nsec);
+    proc_stats.lock_wait_ns += wait_ns;
+    
+    if (lock_stats) {
+        LockStats& s = lock_stats[sem_num];
+        __atomic_fetch_add(&s.acquisitions, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&s.contended, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&s.wait_ns, wait_ns, __ATOMIC_RELAXED);
+        int bucket = 0;
+        for (long bound = 10000; bucket < LOCK_WAIT_BUCKETS - 1 && wait_ns > bound; bound *= 10) bucket++;
+        __atomic_fetch_add(&s.wait_hist[bucket], 1, __ATOMIC_RELAXED);
+    }
 }
 
 void sem_unlock(int sem_id, int sem_num) {
     struct sembuf op = {(unsigned short)sem_num, 1, 0};
+    proc_stats.semops++;
     while (semop(sem_id, &op, 1) == -1) {
         if (errno == EINTR) continue;
         perror("semop unlock");
@@ -79,6 +143,7 @@ void sem_unlock(int sem_id, int sem_num) {
 
 void sem_wait_zero(int sem_id, int sem_num) {
     struct sembuf op = {(unsigned short)sem_num, 0, 0};
+    proc_stats.semops++;
     while (semop(sem_id, &op, 1) == -1) {
         if (errno == EINTR) continue;
         perror("semop wait_zero");
@@ -108,50 +173,124 @@ void remove_sem(int sem_id) {
     }
 }
 
-int create_msgq() {
-    int msg_id = msgget(MSG_KEY, IPC_CREAT | IPC_EXCL | 0600);
-    if (msg_id == -1) {
-        perror("msgget create");
+static long futex(uint32_t* word, int op, uint32_t val) {
+    proc_stats.futex_calls++;
+    return syscall(SYS_futex, word, op, val, nullptr, nullptr, 0);
+}
+
+// Counting semaphore on a shared 32-bit word; each word has a single waiter
+void futex_sem_post(uint32_t* word) {
+    __atomic_fetch_add(word, 1, __ATOMIC_RELEASE);
+    if (futex(word, FUTEX_WAKE, 1) == -1) {
+        perror("futex wake");
         exit(1);
     }
-    return msg_id;
 }
 
-int get_msgq() {
-    int msg_id = msgget(MSG_KEY, 0600);
-    if (msg_id == -1) {
-        perror("msgget get");
-        exit(1);
+void futex_sem_wait(uint32_t* word) {
+    while (true) {
+        uint32_t val = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+        if (val > 0) {
+            if (__atomic_compare_exchange_n(word, &val, val - 1, false,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return;
+            continue;
+        }
+        if (futex(word, FUTEX_WAIT, 0) == -1 && errno != EAGAIN && errno != EINTR) {
+            perror("futex wait");
+            exit(1);
+        }
     }
-    return msg_id;
 }
 
-void send_msg(int msg_id, long type, int data) {
-    MsgBuf msg;
-    msg.mtype = type;
-    msg.data = data;
-    while (msgsnd(msg_id, &msg, sizeof(msg.data), 0) == -1) {
-        if (errno == EINTR) continue;
-        perror("msgsnd");
+// Writers are serialized by SEM_BRIDGE; an odd value means an update is in progress
+void seq_write_begin(uint32_t* seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void seq_write_end(uint32_t* seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+uint32_t seq_read_begin(const uint32_t* seq) {
+    uint32_t v;
+    while ((v = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1)
+        sched_yield();
+    return v;
+}
+
+bool seq_read_retry(const uint32_t* seq, uint32_t start) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(seq, __ATOMIC_RELAXED) != start;
+}
+
+// Multi-producer push; a full ring rings the consumer's doorbell and retries
+void ring_push(EventRing* ring, RiderEventType type, int pid, int wake_fd) {
+    uint64_t pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    while (true) {
+        RingSlot& slot = ring->slots[pos % EVENT_RING_SIZE];
+        uint32_t lap = (uint32_t)(pos / EVENT_RING_SIZE);
+        uint32_t turn = __atomic_load_n(&slot.turn, __ATOMIC_ACQUIRE);
+        
+        if (turn == 2 * lap) {
+            if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                slot.type = type;
+                slot.pid = pid;
+                __atomic_store_n(&slot.turn, 2 * lap + 1, __ATOMIC_RELEASE);
+                return;
+            }
+        } else if ((int32_t)(turn - 2 * lap) < 0) {
+            notify_eventfd(wake_fd);
+            sched_yield();
+            pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        } else {
+            pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// Single consumer
+bool ring_pop(EventRing* ring, RiderEvent& ev) {
+    uint64_t pos = ring->tail;
+    RingSlot& slot = ring->slots[pos % EVENT_RING_SIZE];
+    uint32_t lap = (uint32_t)(pos / EVENT_RING_SIZE);
+    if (__atomic_load_n(&slot.turn, __ATOMIC_ACQUIRE) != 2 * lap + 1) return false;
+    
+    ev.type = (RiderEventType)slot.type;
+    ev.pid = slot.pid;
+    __atomic_store_n(&slot.turn, 2 * lap + 2, __ATOMIC_RELEASE);
+    ring->tail = pos + 1;
+    return true;
+}
+
+int create_eventfd() {
+    int fd = eventfd(0, EFD_NONBLOCK);
+    if (fd == -1) {
+        perror("eventfd");
         exit(1);
     }
+    return fd;
 }
 
-bool recv_msg(int msg_id, long type, int& data, bool wait) {
-    MsgBuf msg;
-    int flags = wait ? 0 : IPC_NOWAIT;
-    while (msgrcv(msg_id, &msg, sizeof(msg.data), type, flags) == -1) {
+void notify_eventfd(int fd) {
+    uint64_t one = 1;
+    proc_stats.eventfd_calls++;
+    while (write(fd, &one, sizeof(one)) == -1) {
         if (errno == EINTR) continue;
-        if (errno == ENOMSG) return false;
-        perror("msgrcv");
+        if (errno == EAGAIN) return;
+        perror("eventfd write");
         exit(1);
     }
-    data = msg.data;
-    return true;
 }
 
-void remove_msgq(int msg_id) {
-    if (msgctl(msg_id, IPC_RMID, nullptr) == -1) {
-        perror("msgctl remove");
+void drain_eventfd(int fd) {
+    uint64_t count;
+    proc_stats.eventfd_calls++;
+    while (read(fd, &count, sizeof(count)) == -1) {
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN) return;
+        perror("eventfd read");
+        exit(1);
     }
 }
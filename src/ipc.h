@@ -9,6 +9,9 @@ SharedState* attach_shm(int shm_id);
 void detach_shm(SharedState* state);
 void remove_shm(int shm_id);
 
+void track_lock_stats(LockStats* stats);
+void flush_proc_stats(SharedState* state);
+const char* sem_name(int sem_num);
 int create_sem(int nsems);
 int get_sem();
 void sem_lock(int sem_id, int sem_num);
@@ -18,10 +21,19 @@ void sem_set(int sem_id, int sem_num, int val);
 int sem_get(int sem_id, int sem_num);
 void remove_sem(int sem_id);
 
-int create_msgq();
-int get_msgq();
-void send_msg(int msg_id, long type, int data);
-bool recv_msg(int msg_id, long type, int& data, bool wait = true);
-void remove_msgq(int msg_id);
+void futex_sem_post(uint32_t* word);
+void futex_sem_wait(uint32_t* word);
+
+void seq_write_begin(uint32_t* seq);
+void seq_write_end(uint32_t* seq);
+uint32_t seq_read_begin(const uint32_t* seq);
+bool seq_read_retry(const uint32_t* seq, uint32_t start);
+
+void ring_push(EventRing* ring, RiderEventType type, int pid, int wake_fd);
+bool ring_pop(EventRing* ring, RiderEvent& ev);
+
+int create_eventfd();
+void notify_eventfd(int fd);
+void drain_eventfd(int fd);
 
 #endif
@@ -0,0 +1,144 @@
+#include "journal.h"
+#include "logger.h"
+#include "trace.h"
+#include <sys/mman.h>
+#include <fcntl.h>
+
+// Records land in a shared mapping of the file like log lines do: a fetch-add
+// picks the slot, so journaling adds no syscall inside the riders' critical sections
+#define JOURNAL_CHUNK_SIZE (1L << 20)
+#define JOURNAL_MAP_SIZE (4L << 30)
+
+static int journal_fd = -1;
+static char* journal_map = nullptr;
+static bool journal_failed = false;
+
+static long records_offset(const SharedState* state) {
+    return sizeof(JournalHeader) + state->passenger_count;
+}
+
+static bool map_journal(SharedState* state) {
+    if (journal_map) return true;
+    if (journal_failed) return false;
+    
+    journal_fd = open(state->journal_file, O_RDWR);
+    void* ptr = journal_fd == -1 ? MAP_FAILED :
+                mmap(nullptr, JOURNAL_MAP_SIZE, PROT_WRITE, MAP_SHARED, journal_fd, 0);
+    if (ptr == MAP_FAILED) {
+        perror("map journal");
+        if (journal_fd != -1) close(journal_fd);
+        journal_failed = true;
+        return false;
+    }
+    journal_map = static_cast<char*>(ptr);
+    return true;
+}
+
+// Same growth scheme as the log: fallocate never shrinks, so racing growers are harmless
+static bool reserve_journal(SharedState* state, long end) {
+    long cap = __atomic_load_n(&state->journal_capacity, __ATOMIC_ACQUIRE);
+    while (end > cap) {
+        long new_cap = (end / JOURNAL_CHUNK_SIZE + 1) * JOURNAL_CHUNK_SIZE;
+        if (new_cap > JOURNAL_MAP_SIZE) new_cap = JOURNAL_MAP_SIZE;
+        if (posix_fallocate(journal_fd, 0, new_cap) != 0) return false;
+        __atomic_compare_exchange_n(&state->journal_capacity, &cap, new_cap, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    }
+    return true;
+}
+
+void init_journal(SharedState* state, const Config& cfg) {
+    snprintf(state->journal_file, sizeof(state->journal_file), "%.*s.jnl",
+             (int)(strlen(state->log_file) - 4), state->log_file);
+
+    int fd = open(state->journal_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror("open journal");
+        exit(1);
+    }
+
+    JournalHeader hdr = {};
+    hdr.magic = JOURNAL_MAGIC;
+    hdr.version = JOURNAL_VERSION;
+    hdr.n = cfg.N;
+    hdr.m = cfg.M;
+    hdr.k = cfg.K;
+    hdr.t1 = cfg.T1;
+    hdr.t2 = cfg.T2;
+    hdr.r = cfg.R;
+    hdr.passenger_count = state->passenger_count;
+    hdr.rider_trips = state->rider_trips;
+    hdr.capacity = state->capacity;
+    memcpy(hdr.kind_cost, state->kind_cost, sizeof(hdr.kind_cost));
+
+    uint8_t* flags = new uint8_t[state->passenger_count];
+    for (int i = 0; i < state->passenger_count; i++) {
+        flags[i] = rider_kind(state, i) |
+                   (rider_location(state, i) == WAWEL ? RIDER_FLAG_WAWEL : 0) |
+                   (rider_class(state, i) << RIDER_FLAG_CLASS_SHIFT);
+    }
+
+    if (write(fd, &hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr) ||
+        write(fd, flags, state->passenger_count) != (ssize_t)state->passenger_count) {
+        perror("write journal header");
+        exit(1);
+    }
+    delete[] flags;
+    close(fd);
+
+    state->journal_count = 0;
+    state->journal_capacity = records_offset(state);
+    state->journal_drops = 0;
+    state->journal_enabled = true;
+}
+
+void journal_event(SharedState* state, JournalEventType type, int pid, int aux) {
+    if (state->trace_enabled) trace_record(state, type, pid, aux);
+    if (!state->journal_enabled) return;
+
+    JournalRecord rec;
+    rec.time_us = (uint64_t)get_elapsed_us(state);
+    rec.pid = pid;
+    rec.type = type;
+    rec.aux = (uint8_t)aux;
+    rec.trip = (uint16_t)state->trip_num;
+
+    long idx = __atomic_fetch_add(&state->journal_count, 1, __ATOMIC_ACQ_REL);
+    long off = records_offset(state) + idx * (long)sizeof(rec);
+    if (off + (long)sizeof(rec) <= JOURNAL_MAP_SIZE && map_journal(state) &&
+        reserve_journal(state, off + sizeof(rec))) {
+        memcpy(journal_map + off, &rec, sizeof(rec));
+    } else {
+        __atomic_fetch_add(&state->journal_drops, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Called by main once every writer has exited: cuts the file down to the records written
+void close_journal(SharedState* state) {
+    if (journal_map) {
+        munmap(journal_map, JOURNAL_MAP_SIZE);
+        journal_map = nullptr;
+        close(journal_fd);
+    }
+    long size = records_offset(state) + state->journal_count * (long)sizeof(JournalRecord);
+    if (size > JOURNAL_MAP_SIZE) size = JOURNAL_MAP_SIZE;
+    if (truncate(state->journal_file, size) == -1) perror("truncate journal");
+    if (state->journal_drops > 0)
+        log_msg<LOG_WARN>(state, "Journal: dropped %ld events", state->journal_drops);
+}
+
+const char* journal_event_name(uint8_t type) {
+    switch (type) {
+        case EV_ADMIT: return "ADMIT";
+        case EV_BOARD: return "BOARD";
+        case EV_RETURN: return "RETURN";
+        case EV_DISEMBARK: return "DISEMBARK";
+        case EV_EXIT: return "EXIT";
+        case EV_SIGNAL1: return "SIGNAL1";
+        case EV_SIGNAL2: return "SIGNAL2";
+        case EV_PHASE: return "PHASE";
+        case EV_DAY: return "DAY";
+        case EV_REJOIN: return "REJOIN";
+        default: return "UNKNOWN";
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "common.h"
+#include "config.h"
+#include <cstdint>
+
+#define JOURNAL_MAGIC 0x4c4e524a
+#define JOURNAL_VERSION 3
+
+enum JournalEventType : uint8_t {
+    EV_ADMIT = 1,
+    EV_BOARD = 2,
+    EV_RETURN = 3,
+    EV_DISEMBARK = 4,
+    EV_EXIT = 5,
+    EV_SIGNAL1 = 6,
+    EV_SIGNAL2 = 7,
+    EV_PHASE = 8,
+    EV_DAY = 9,
+    EV_REJOIN = 10
+};
+
+#define RIDER_FLAG_KIND_MASK 0x3
+#define RIDER_FLAG_WAWEL 0x4
+#define RIDER_FLAG_CLASS_SHIFT 3
+#define RIDER_FLAG_CLASS_MASK 0x18
+
+// File layout: JournalHeader, passenger_count rider flag bytes, then JournalRecords
+struct JournalHeader {
+    uint32_t magic;
+    uint32_t version;
+    int32_t n, m, k, t1, t2, r;
+    int32_t passenger_count;
+    int32_t rider_trips;
+    uint64_t capacity;
+    uint64_t kind_cost[RIDER_KINDS];
+};
+
+struct JournalRecord {
+    uint64_t time_us;
+    int32_t pid;
+    uint8_t type;
+    uint8_t aux;
+    uint16_t trip;
+};
+
+void init_journal(SharedState* state, const Config& cfg);
+void journal_event(SharedState* state, JournalEventType type, int pid, int aux);
+void close_journal(SharedState* state);
+const char* journal_event_name(uint8_t type);
+
+#endif
@@ -1,15 +1,97 @@
 #include "logger.h"
-#include <sys/time.h>
-#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <cstdio>
 #include <cstdarg>
 #include <cstring>
+#include <algorithm>
+
+#define LOG_TIMESTAMP_LEN 14
+
+LogCategory log_category = CAT_MAIN;
+static char log_source[16] = "MAIN";
+static int log_fd[MAX_LOG_SEGMENTS];
+static char* log_map[MAX_LOG_SEGMENTS];
+static long log_lines = 0;
+
+// Segment 0 is simulation_X.log itself; later ones are simulation_X.<k>.log
+static void segment_name(SharedState* state, int seg, char* buf, size_t size) {
+    if (seg == 0) snprintf(buf, size, "%s", state->log_file);
+    else snprintf(buf, size, "%.*s.%d.log", (int)(strlen(state->log_file) - 4), state->log_file, seg);
+}
+
+static bool map_log(SharedState* state, int seg) {
+    if (log_map[seg]) return true;
+    
+    char name[300];
+    segment_name(state, seg, name, sizeof(name));
+    int fd = open(name, O_RDWR);
+    if (fd == -1) {
+        perror("open log");
+        return false;
+    }
+    void* ptr = mmap(nullptr, LOG_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        perror("mmap log");
+        close(fd);
+        return false;
+    }
+    log_fd[seg] = fd;
+    log_map[seg] = static_cast<char*>(ptr);
+    return true;
+}
+
+// Grows the file in LOG_CHUNK_SIZE steps; fallocate never shrinks, so racing growers are harmless
+static bool reserve_log(LogSegment& segment, int fd, long end) {
+    long cap = __atomic_load_n(&segment.capacity, __ATOMIC_ACQUIRE);
+    while (end > cap) {
+        long new_cap = (end / LOG_CHUNK_SIZE + 1) * LOG_CHUNK_SIZE;
+        if (new_cap > LOG_MAP_SIZE) new_cap = LOG_MAP_SIZE;
+        if (posix_fallocate(fd, 0, new_cap) != 0) return false;
+        __atomic_compare_exchange_n(&segment.capacity, &cap, new_cap, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    }
+    return true;
+}
+
+static bool create_segment(SharedState* state, int seg) {
+    char name[300];
+    segment_name(state, seg, name, sizeof(name));
+    int fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1 || posix_fallocate(fd, 0, LOG_CHUNK_SIZE) != 0) {
+        perror("create log");
+        if (fd != -1) close(fd);
+        return false;
+    }
+    close(fd);
+    
+    LogSegment& segment = state->log_segments[seg];
+    segment.offset = 0;
+    segment.capacity = LOG_CHUNK_SIZE;
+    segment.start_us = seg == 0 ? 0 : get_elapsed_us(state);
+    // Segment 0 is created before the run's day counter is set
+    segment.first_day = std::max(state->day, 1);
+    segment.first_trip = state->trip_num;
+    segment.rolled = 0;
+    return true;
+}
+
+// Whoever wins the flag on the full segment opens the next one and publishes it;
+// late writers that already picked the old segment still land in it
+static void roll_log(SharedState* state, int seg) {
+    if (seg + 1 >= MAX_LOG_SEGMENTS) return;
+    int expected = 0;
+    if (!__atomic_compare_exchange_n(&state->log_segments[seg].rolled, &expected, 1, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return;
+    if (create_segment(state, seg + 1))
+        __atomic_store_n(&state->log_segment, seg + 1, __ATOMIC_RELEASE);
+}
 
 void init_logger(SharedState* state) {
-    struct timeval tv;
-    gettimeofday(&tv, nullptr);
-    state->start_time_sec = tv.tv_sec;
-    state->start_time_usec = tv.tv_usec;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    state->start_time_ns = ts.tv_sec * 1000000000L + ts.tv_nsec;
     
     time_t now = time(nullptr);
     struct tm* t = localtime(&now);
@@ -17,45 +99,169 @@ void init_logger(SharedState* state) {
              "simulation_%04d%02d%02d_%02d%02d%02d.log",
              t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
              t->tm_hour, t->tm_min, t->tm_sec);
+    
+    if (!create_segment(state, 0)) exit(1);
+    state->log_segment = 0;
 }
 
-std::string get_timestamp(SharedState* state) {
-    struct timeval tv;
-    gettimeofday(&tv, nullptr);
+void log_new_trip(SharedState* state) {
+    int trip = state->trip_num;
+    if (state->log_segment_trips > 0 && trip > 1 && (trip - 1) % state->log_segment_trips == 0)
+        roll_log(state, __atomic_load_n(&state->log_segment, __ATOMIC_ACQUIRE));
     
-    long elapsed_usec = (tv.tv_sec - state->start_time_sec) * 1000000L + 
-                        (tv.tv_usec - state->start_time_usec);
+    if (state->log_mark_count >= MAX_LOG_MARKS) return;
+    int seg = __atomic_load_n(&state->log_segment, __ATOMIC_ACQUIRE);
+    LogMark& mark = state->log_marks[state->log_mark_count++];
+    mark.day = state->day;
+    mark.trip = trip;
+    mark.segment = seg;
+    mark.offset = __atomic_load_n(&state->log_segments[seg].offset, __ATOMIC_ACQUIRE);
+    mark.time_us = get_elapsed_us(state);
+}
+
+static void write_log_index(SharedState* state, int segments) {
+    char path[300];
+    snprintf(path, sizeof(path), "%.*s.idx", (int)(strlen(state->log_file) - 4), state->log_file);
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        perror("open log index");
+        return;
+    }
+    fprintf(f, "# segment <n> <file> <start_ms> <first_day> <first_trip> <bytes>\n");
+    for (int i = 0; i < segments; i++) {
+        char name[300];
+        segment_name(state, i, name, sizeof(name));
+        const LogSegment& s = state->log_segments[i];
+        fprintf(f, "segment %d %s %ld %d %d %ld\n", i, name, s.start_us / 1000, s.first_day, s.first_trip,
+                s.offset < LOG_MAP_SIZE ? s.offset : LOG_MAP_SIZE);
+    }
+    fprintf(f, "# trip <day> <n> <segment> <offset> <time_ms>\n");
+    for (int i = 0; i < state->log_mark_count; i++) {
+        const LogMark& m = state->log_marks[i];
+        fprintf(f, "trip %d %d %d %ld %ld\n", m.day, m.trip, m.segment, m.offset, m.time_us / 1000);
+    }
+    fclose(f);
+}
+
+// A writer that died between reserving its bytes and copying the line leaves zeros;
+// each such run becomes a blank line so readers never see NULs glued to the next line
+static long fill_log_gaps(char* data, long size) {
+    long filled = 0;
+    for (long i = 0; i < size; i++) {
+        if (data[i] != '\0') continue;
+        long j = i;
+        while (j < size && data[j] == '\0') j++;
+        memset(data + i, ' ', j - i - 1);
+        data[j - 1] = '\n';
+        filled += j - i;
+        i = j - 1;
+    }
+    return filled;
+}
+
+void close_logger(SharedState* state) {
+    long gaps = 0;
+    for (int i = 0; i <= __atomic_load_n(&state->log_segment, __ATOMIC_ACQUIRE); i++) {
+        long size = __atomic_load_n(&state->log_segments[i].offset, __ATOMIC_ACQUIRE);
+        if (size > LOG_MAP_SIZE) size = LOG_MAP_SIZE;
+        struct stat st;
+        // Reservations past a failed grow were dropped; touching them would fault
+        if (map_log(state, i) && fstat(log_fd[i], &st) == 0)
+            gaps += fill_log_gaps(log_map[i], std::min(size, (long)st.st_size));
+    }
+    if (gaps > 0) log_msg<LOG_WARN>(state, "Log: %ld reserved bytes were never written", gaps);
     
-    int hours = (int)(elapsed_usec / 3600000000L);
-    int mins = (int)((elapsed_usec % 3600000000L) / 60000000L);
-    int secs = (int)((elapsed_usec % 60000000L) / 1000000L);
-    int msecs = (int)((elapsed_usec % 1000000L) / 1000L);
+    for (int i = 0; i < MAX_LOG_SEGMENTS; i++) {
+        if (!log_map[i]) continue;
+        munmap(log_map[i], LOG_MAP_SIZE);
+        log_map[i] = nullptr;
+        close(log_fd[i]);
+    }
     
-    char buf[32];
-    snprintf(buf, sizeof(buf), "[%02d:%02d:%02d.%03d]", hours, mins, secs, msecs);
-    return std::string(buf);
+    int segments = __atomic_load_n(&state->log_segment, __ATOMIC_ACQUIRE) + 1;
+    for (int i = 0; i < segments; i++) {
+        char name[300];
+        segment_name(state, i, name, sizeof(name));
+        long size = __atomic_load_n(&state->log_segments[i].offset, __ATOMIC_ACQUIRE);
+        if (size > LOG_MAP_SIZE) size = LOG_MAP_SIZE;
+        if (truncate(name, size) == -1) {
+            perror("truncate log");
+        }
+    }
+    if (state->log_segment_size > 0 || state->log_segment_trips > 0)
+        write_log_index(state, segments);
+}
+
+long get_elapsed_us(SharedState* state) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000000000L + ts.tv_nsec - state->start_time_ns) / 1000;
 }
 
-void log_msg(SharedState* state, const char* source, const char* format, ...) {
-    char msg[512];
+static char* put_digits(char* p, long val, int width) {
+    for (int i = width - 1; i >= 0; i--) {
+        p[i] = '0' + val % 10;
+        val /= 10;
+    }
+    return p + width;
+}
+
+// Writes "[HH:MM:SS.mmm]" (LOG_TIMESTAMP_LEN bytes, no terminator)
+void format_timestamp(SharedState* state, char* buf) {
+    long elapsed_msec = get_elapsed_us(state) / 1000;
+    
+    *buf++ = '[';
+    buf = put_digits(buf, (elapsed_msec / 3600000L) % 100, 2);
+    *buf++ = ':';
+    buf = put_digits(buf, (elapsed_msec % 3600000L) / 60000L, 2);
+    *buf++ = ':';
+    buf = put_digits(buf, (elapsed_msec % 60000L) / 1000L, 2);
+    *buf++ = '.';
+    buf = put_digits(buf, elapsed_msec % 1000L, 3);
+    *buf = ']';
+}
+
+void set_log_source(LogCategory cat, const char* source) {
+    log_category = cat;
+    snprintf(log_source, sizeof(log_source), "%s", source);
+}
+
+void log_write(SharedState* state, const char* format, ...) {
+    char line[640];
+    format_timestamp(state, line);
+    int len = LOG_TIMESTAMP_LEN;
+    len += snprintf(line + len, sizeof(line) - len, " [%s] ", log_source);
+    
     va_list args;
     va_start(args, format);
-    vsnprintf(msg, sizeof(msg), format, args);
+    int msg_len = vsnprintf(line + len, sizeof(line) - len - 1, format, args);
     va_end(args);
     
-    std::string ts = get_timestamp(state);
+    len += msg_len < (int)(sizeof(line) - len - 1) ? msg_len : (int)(sizeof(line) - len - 2);
+    line[len++] = '\n';
     
-    FILE* f = fopen(state->log_file, "a");
-    if (f) {
-        flock(fileno(f), LOCK_EX);
-        fprintf(f, "%s [%s] %s\n", ts.c_str(), source, msg);
-        fflush(f);
-        flock(fileno(f), LOCK_UN);
-        fclose(f);
+    log_lines++;
+    int seg = __atomic_load_n(&state->log_segment, __ATOMIC_ACQUIRE);
+    LogSegment& segment = state->log_segments[seg];
+    long off = __atomic_fetch_add(&segment.offset, len, __ATOMIC_ACQ_REL);
+    if (off + len <= LOG_MAP_SIZE && map_log(state, seg) && reserve_log(segment, log_fd[seg], off + len)) {
+        memcpy(log_map[seg] + off, line, len);
+    } else {
+        __atomic_fetch_add(&state->log_drops, 1, __ATOMIC_RELAXED);
     }
     
-    printf("%s [%s] %s\n", ts.c_str(), source, msg);
-    fflush(stdout);
+    // Exactly one writer crosses the threshold, so exactly one tries to roll
+    long limit = state->log_segment_size;
+    if (limit > 0 && off < limit && off + len >= limit) roll_log(state, seg);
+    
+    if (state->log_stdout) {
+        fwrite(line, 1, len, stdout);
+        fflush(stdout);
+    }
+}
+
+long log_line_count() {
+    return log_lines;
 }
 
 const char* location_name(Location loc) {
@@ -2,11 +2,48 @@
 #define LOGGER_H
 
 #include "common.h"
-#include <string>
+
+enum LogLevel {
+    LOG_ERROR = 0,
+    LOG_WARN = 1,
+    LOG_INFO = 2,
+    LOG_DEBUG = 3
+};
+
+enum LogCategory {
+    CAT_MAIN = 0,
+    CAT_CAPTAIN = 1,
+    CAT_DISPATCHER = 2,
+    CAT_PASSENGER = 3,
+    CAT_AUDITOR = 4,
+    CAT_EXPORTER = 5
+};
+
+#define LOG_ALL_CATEGORIES 0x3F
+
+// Levels above this are compiled out entirely (set via -DTRAM_LOG_LEVEL)
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_DEBUG
+#endif
+
+extern LogCategory log_category;
 
 void init_logger(SharedState* state);
-void log_msg(SharedState* state, const char* source, const char* format, ...);
-std::string get_timestamp(SharedState* state);
+void close_logger(SharedState* state);
+void log_new_trip(SharedState* state);
+void set_log_source(LogCategory cat, const char* source);
+void log_write(SharedState* state, const char* format, ...);
+long log_line_count();
+void format_timestamp(SharedState* state, char* buf);
+long get_elapsed_us(SharedState* state);
 const char* location_name(Location loc);
 
+template <LogLevel L, typename... Args>
+inline void log_msg(SharedState* state, const char* format, Args... args) {
+    if constexpr (L <= LOG_COMPILE_LEVEL) {
+        if (L <= state->log_level && (state->log_categories & (1 << log_category)))
+            log_write(state, format, args...);
+    }
+}
+
 #endif
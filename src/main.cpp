@@ -2,11 +2,28 @@
 #include "config.h"
 #include "ipc.h"
 #include "logger.h"
+#include "journal.h"
+#include "trace.h"
+#include "pier_queue.h"
+#include "phase.h"
+#include "timeline.h"
 #include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <climits>
 #include <iostream>
 #include <vector>
 
-std::vector<pid_t> g_children;
+SharedState* g_state = nullptr;
+pid_t g_main_pid;
+// Captain, auditor, exporter and passengers share the captain's process group;
+// the dispatcher stays in the terminal's foreground group to read keys
+pid_t g_group = 0;
+int g_dispatcher_pidfd = -1;
+volatile sig_atomic_t g_stop = 0;
+struct timespec g_stop_time;
 
 void cleanup_ipc() {
     int shm_id = shmget(SHM_KEY, 0, 0600);
@@ -17,146 +34,313 @@ void cleanup_ipc() {
     
     int msg_id = msgget(MSG_KEY, 0600);
     if (msg_id != -1) msgctl(msg_id, IPC_RMID, nullptr);
+    
+    remove_trace();
 }
 
-void sigchld_handler(int sig) {
-    (void)sig;
-    while (waitpid(-1, nullptr, WNOHANG) > 0);
+// The control FIFO is a file, not an IPC object; the dead run left its path in shared memory
+void remove_stale_fifo(int shm_id) {
+    void* ptr = shmat(shm_id, nullptr, SHM_RDONLY);
+    if (ptr == (void*)-1) return;
+    char path[sizeof(SharedState::control_file)];
+    memcpy(path, static_cast<SharedState*>(ptr)->control_file, sizeof(path));
+    path[sizeof(path) - 1] = '\0';
+    shmdt(ptr);
+    
+    struct stat st;
+    if (path[0] && lstat(path, &st) == 0 && S_ISFIFO(st.st_mode) && unlink(path) == 0)
+        std::cout << "Removed control FIFO " << path << std::endl;
 }
 
+// A segment whose creator is alive and still has processes attached belongs to a
+// running simulation; anything else was leaked by a crashed run and is removed
+bool remove_stale_ipc() {
+    int shm_id = shmget(SHM_KEY, 0, 0600);
+    struct shmid_ds ds;
+    if (shm_id != -1 && shmctl(shm_id, IPC_STAT, &ds) == 0) {
+        if (ds.shm_nattch > 0 && kill(ds.shm_cpid, 0) == 0) {
+            std::cerr << "Error: Simulation " << ds.shm_cpid << " is still running" << std::endl;
+            return false;
+        }
+        std::cout << "Removing IPC objects left by simulation " << ds.shm_cpid
+                  << " (" << ds.shm_nattch << " processes attached)" << std::endl;
+        remove_stale_fifo(shm_id);
+    }
+    cleanup_ipc();
+    return true;
+}
+
+// Async-signal-safe: one kill reaches the whole group, the pidfd cannot hit a recycled pid
+void stop_children() {
+    if (g_group > 0) kill(-g_group, SIGTERM);
+    if (g_dispatcher_pidfd != -1) syscall(SYS_pidfd_send_signal, g_dispatcher_pidfd, SIGTERM, nullptr, 0);
+}
+
+// Reaping is left to the wait loop in main, so the handler never races it for children
 void signal_handler(int sig) {
     (void)sig;
-    for (pid_t p : g_children) {
-        kill(p, SIGTERM);
+    if (!g_stop) clock_gettime(CLOCK_MONOTONIC, &g_stop_time);
+    g_stop = 1;
+    stop_children();
+}
+
+// Children die with main (PR_SET_PDEATHSIG) instead of blocking on removed semaphores
+pid_t spawn(const char* path, const char* arg, bool grouped) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        stop_children();
+        cleanup_ipc();
+        exit(1);
     }
-    while (wait(nullptr) > 0);
-    cleanup_ipc();
-    exit(0);
+    if (pid == 0) {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() != g_main_pid) _exit(1);
+        if (grouped) setpgid(0, g_group);
+        const char* name = strrchr(path, '/') + 1;
+        execl(path, name, arg, nullptr);
+        perror(path);
+        _exit(1);
+    }
+    // Set from both sides so the group exists before either process goes on
+    if (grouped) {
+        if (!g_group) g_group = pid;
+        setpgid(pid, g_group);
+    }
+    return pid;
+}
+
+int open_pidfd(pid_t pid) {
+    int fd = syscall(SYS_pidfd_open, pid, 0);
+    if (fd == -1) perror("pidfd_open");
+    return fd;
+}
+
+void account_rusage(RoleStats& r, const struct rusage& ru) {
+    r.processes++;
+    r.utime_us += ru.ru_utime.tv_sec * 1000000L + ru.ru_utime.tv_usec;
+    r.stime_us += ru.ru_stime.tv_sec * 1000000L + ru.ru_stime.tv_usec;
+    r.vol_csw += ru.ru_nvcsw;
+    r.invol_csw += ru.ru_nivcsw;
+}
+
+void report_role_stats(SharedState* state) {
+    static const char* names[ROLE_COUNT] = {"main", "captain", "dispatcher", "passenger", "auditor", "exporter"};
+    for (int i = 0; i < ROLE_COUNT; i++) {
+        const RoleStats& r = state->role_stats[i];
+        if (r.processes == 0) continue;
+        log_msg<LOG_INFO>(state, "Role %-10s %6ld procs, CPU %9.1f ms user %9.1f ms sys, csw %8ld vol %6ld invol",
+                          names[i], r.processes, r.utime_us / 1e3, r.stime_us / 1e3, r.vol_csw, r.invol_csw);
+        log_msg<LOG_INFO>(state, "Role %-10s semop %8ld (%.3f ms blocked), futex %8ld, eventfd %6ld, log lines %8ld",
+                          names[i], r.semops, r.lock_wait_ns / 1e6, r.futex_calls, r.eventfd_calls, r.log_lines);
+    }
+}
+
+// Ticket class of a pier's nth rider; 37 is coprime to 100, so every block
+// of 100 riders gets exactly the configured shares, spread along the queue
+uint8_t class_bits(const Config& cfg, int nth) {
+    int v = nth * 37 % 100;
+    RiderClass c = CLASS_STANDARD;
+    if (v < cfg.season_pct) c = CLASS_SEASON;
+    else if (v < cfg.season_pct + cfg.priority_pct) c = CLASS_PRIORITY;
+    return c << RIDER_CLASS_SHIFT;
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <config.env>" << std::endl;
+    if (argc != 2 && argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <config.env> [scenario.timeline]" << std::endl;
         return 1;
     }
+    const char* timeline_file = argc == 3 ? argv[2] : nullptr;
     
-    cleanup_ipc();
+    if (!remove_stale_ipc()) return 1;
+    g_main_pid = getpid();
     
     Config cfg;
     if (!load_config(argv[1], cfg)) return 1;
-    if (!validate_config(cfg)) return 1;
+    if (!validate_config(cfg) || !check_process_limit(cfg)) return 1;
+    
+    // Parsed here only to fail before anything is forked; the dispatcher loads it again
+    Timeline timeline;
+    if (timeline_file && !load_timeline(timeline_file, timeline)) return 1;
     
     std::cout << "=== Water Tram Simulator ===" << std::endl;
     print_config(cfg);
     
-    int total_passengers = cfg.tyniec_people + cfg.tyniec_bikes + cfg.wawel_people + cfg.wawel_bikes;
-    int num_sems = SEM_PASSENGER_BASE + total_passengers;
-    
+    int total_passengers = total_riders(cfg);
     int shm_id = create_shm(sizeof(SharedState));
-    int sem_id = create_sem(num_sems);
-    int msg_id = create_msgq();
+    int sem_id = create_sem(SEM_COUNT);
     
     SharedState* state = attach_shm(shm_id);
     memset(state, 0, sizeof(SharedState));
     
     init_logger(state);
+    g_state = state;
+    state->log_level = cfg.log_level;
+    state->log_categories = cfg.log_categories;
+    state->log_stdout = cfg.log_stdout;
+    state->log_segment_size = (long)cfg.log_segment_mb << 20;
+    state->log_segment_trips = cfg.log_segment_trips;
     
     state->phase = PHASE_INIT;
     state->ship_location = TYNIEC;
     state->trip_num = 0;
     state->max_trips = cfg.R;
-    state->ship_capacity_people = cfg.N;
-    state->ship_capacity_bikes = cfg.M;
-    state->bridge_capacity = cfg.K;
+    state->day = 1;
+    state->days = cfg.days;
+    state->capacity = res_vec(cfg.K, cfg.N, cfg.M, cfg.spaces);
+    for (int kind = 0; kind < RIDER_KINDS; kind++) state->kind_cost[kind] = kind_cost(cfg, kind);
+#ifdef TRAM_FIXED
+    // Decided once here so the captain and every rider take the same path
+    state->fixed_shape = compiled_shape_matches(*state, rider_kinds(cfg));
+#endif
     state->queue_to_bridge_time = cfg.queue_to_bridge_time;
     state->bridge_to_ship_time = cfg.bridge_to_ship_time;
     state->ship_to_bridge_time = cfg.ship_to_bridge_time;
     state->bridge_to_exit_time = cfg.bridge_to_exit_time;
     state->t1 = cfg.T1;
     state->t2 = cfg.T2;
+    state->departure_policy = cfg.departure;
+    state->min_dwell = cfg.min_dwell;
+    state->max_dwell = effective_max_dwell(cfg);
     state->passenger_count = total_passengers;
+    state->audit_interval_ms = cfg.audit;
+    state->metrics_port = cfg.metrics_port;
+    state->captain_efd = create_eventfd();
+    state->signal_efd = create_eventfd();
+    state->dispatcher_efd = create_eventfd();
+    state->timeline_enabled = timeline_file != nullptr;
     
-    int pid = 0;
-    for (int i = 0; i < cfg.tyniec_people; i++, pid++) {
-        state->passenger_state[pid] = STATE_QUEUE;
-        state->passenger_location[pid] = TYNIEC;
-        state->passenger_has_bike[pid] = false;
-        state->queue_tyniec[state->queue_tyniec_size++] = pid;
-    }
-    for (int i = 0; i < cfg.tyniec_bikes; i++, pid++) {
-        state->passenger_state[pid] = STATE_QUEUE;
-        state->passenger_location[pid] = TYNIEC;
-        state->passenger_has_bike[pid] = true;
-        state->queue_tyniec[state->queue_tyniec_size++] = pid;
+    snprintf(state->control_file, sizeof(state->control_file), "%.*s.ctl",
+             (int)(strlen(state->log_file) - 4), state->log_file);
+    // Absolute, so the next run can remove it after a crash whatever its working directory
+    char fifo_path[PATH_MAX];
+    if (mkfifo(state->control_file, 0600) == -1) {
+        perror("mkfifo");
+        state->control_file[0] = '\0';
+    } else if (realpath(state->control_file, fifo_path) && strlen(fifo_path) < sizeof(state->control_file)) {
+        strcpy(state->control_file, fifo_path);
     }
-    for (int i = 0; i < cfg.wawel_people; i++, pid++) {
-        state->passenger_state[pid] = STATE_QUEUE;
-        state->passenger_location[pid] = WAWEL;
-        state->passenger_has_bike[pid] = false;
-        state->queue_wawel[state->queue_wawel_size++] = pid;
-    }
-    for (int i = 0; i < cfg.wawel_bikes; i++, pid++) {
-        state->passenger_state[pid] = STATE_QUEUE;
-        state->passenger_location[pid] = WAWEL;
-        state->passenger_has_bike[pid] = true;
-        state->queue_wawel[state->queue_wawel_size++] = pid;
+    
+    state->priority_skip = cfg.priority_skip;
+    state->rider_trips = cfg.rider_trips;
+    state->destination_dwell = cfg.destination_dwell;
+    
+    // Each pier queues its riders kind by kind: walkers first, then bikes, strollers, wheelchairs
+    int pid = 0;
+    for (int loc = TYNIEC; loc <= WAWEL; loc++) {
+        int nth = 0;
+        for (int kind = 0; kind < RIDER_KINDS; kind++) {
+            for (int i = 0; i < pier_riders(cfg, loc, kind); i++, pid++, nth++) {
+                state->rider_flags[pid] = STATE_QUEUE | (loc == WAWEL ? RIDER_WAWEL : 0) |
+                                          kind << RIDER_KIND_SHIFT | class_bits(cfg, nth);
+                queue_push(state, (Location)loc, pid);
+            }
+        }
     }
     
-    sem_set(sem_id, SEM_MUTEX, 1);
+    if (cfg.journal) init_journal(state, cfg);
+    if (cfg.trace) init_trace(state);
+    
+    sem_set(sem_id, SEM_STATE, 1);
+    sem_set(sem_id, SEM_QUEUE_TYNIEC, 1);
+    sem_set(sem_id, SEM_QUEUE_WAWEL, 1);
+    sem_set(sem_id, SEM_BRIDGE, 1);
+    sem_set(sem_id, SEM_SHIP, 1);
     sem_set(sem_id, SEM_CAPTAIN_READY, 0);
-    for (int i = 0; i < total_passengers; i++) {
-        sem_set(sem_id, SEM_PASSENGER_BASE + i, 0);
-    }
     
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
-    signal(SIGCHLD, sigchld_handler);
     
-    log_msg(state, "MAIN", "Created %d passengers", total_passengers);
-    log_msg(state, "MAIN", "Tyniec queue: %d, Wawel queue: %d", 
-            state->queue_tyniec_size, state->queue_wawel_size);
+    log_msg<LOG_INFO>(state, "Config: N=%d M=%d K=%d T1=%d T2=%d R=%d", cfg.N, cfg.M, cfg.K, cfg.T1, cfg.T2, cfg.R);
+    log_msg<LOG_INFO>(state, "Created %d passengers", total_passengers);
+    log_msg<LOG_INFO>(state, "Tyniec queue: %d, Wawel queue: %d", 
+            pier_waiting(state, TYNIEC), pier_waiting(state, WAWEL));
+    if (cfg.priority_pct || cfg.season_pct)
+        log_msg<LOG_INFO>(state, "Tickets: %d%% priority, %d%% season pass, skip %d per class",
+                cfg.priority_pct, cfg.season_pct, cfg.priority_skip);
+#ifdef TRAM_FIXED
+    if (state->fixed_shape)
+        log_msg<LOG_INFO>(state, "Fixed build: compiled-in capacities and rider costs, %d rider slots", MAX_PASSENGERS);
+    else
+        log_msg<LOG_WARN>(state, "Fixed build: config differs from the compiled-in shape, using runtime capacity checks");
+#endif
     
-    pid_t captain_pid = fork();
-    if (captain_pid == -1) { perror("fork captain"); cleanup_ipc(); return 1; }
-    if (captain_pid == 0) {
-        execl("./captain", "captain", nullptr);
-        perror("execl captain");
-        _exit(1);
-    }
-    g_children.push_back(captain_pid);
+    pid_t captain_pid = spawn("./captain", nullptr, true);
+    pid_t dispatcher_pid = spawn("./dispatcher", timeline_file, false);
+    g_dispatcher_pidfd = open_pidfd(dispatcher_pid);
+    pid_t auditor_pid = cfg.audit ? spawn("./auditor", nullptr, true) : 0;
+    pid_t exporter_pid = cfg.metrics_port ? spawn("./exporter", nullptr, true) : 0;
     
-    pid_t dispatcher_pid = fork();
-    if (dispatcher_pid == -1) { perror("fork dispatcher"); cleanup_ipc(); return 1; }
-    if (dispatcher_pid == 0) {
-        execl("./dispatcher", "dispatcher", nullptr);
-        perror("execl dispatcher");
-        _exit(1);
-    }
-    g_children.push_back(dispatcher_pid);
-    
-    for (int i = 0; i < total_passengers; i++) {
-        pid_t p = fork();
-        if (p == -1) { perror("fork passenger"); cleanup_ipc(); return 1; }
-        if (p == 0) {
-            char id_str[16];
-            snprintf(id_str, sizeof(id_str), "%d", i);
-            execl("./passenger", "passenger", id_str, nullptr);
-            perror("execl passenger");
-            _exit(1);
-        }
-        g_children.push_back(p);
+    for (int i = 0; i < total_passengers && !g_stop; i++) {
+        char id_str[16];
+        snprintf(id_str, sizeof(id_str), "%d", i);
+        spawn("./passenger", id_str, true);
     }
+    // Anything forked after the signal arrived missed the first group kill
+    if (g_stop) stop_children();
     
-    log_msg(state, "MAIN", "All processes started");
+    log_msg<LOG_INFO>(state, "All processes started");
+    log_msg<LOG_INFO>(state, "Control FIFO: %s", state->control_file);
+    if (state->journal_enabled)
+        log_msg<LOG_INFO>(state, "Event journal: %s", state->journal_file);
+    if (timeline_file)
+        log_msg<LOG_INFO>(state, "Timeline: %s (%zu timed, %zu trip signals)", timeline_file,
+                timeline.timed.size(), timeline.trips.size());
     
     state->phase = PHASE_LOADING;
     sem_unlock(sem_id, SEM_CAPTAIN_READY);
     
     int status;
-    while (wait(&status) > 0);
+    struct rusage ru;
+    pid_t child;
+    while ((child = wait4(-1, &status, 0, &ru)) > 0) {
+        int role = CAT_PASSENGER;
+        if (child == captain_pid) role = CAT_CAPTAIN;
+        else if (child == dispatcher_pid) role = CAT_DISPATCHER;
+        else if (child == auditor_pid) role = CAT_AUDITOR;
+        else if (child == exporter_pid) role = CAT_EXPORTER;
+        account_rusage(state->role_stats[role], ru);
+        if (child == dispatcher_pid) {
+            int fd = g_dispatcher_pidfd;
+            g_dispatcher_pidfd = -1;
+            close(fd);
+        }
+    }
+    
+    if (g_stop) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        log_msg<LOG_INFO>(state, "Interrupted: all processes stopped in %.1f ms",
+                (now.tv_sec - g_stop_time.tv_sec) * 1e3 + (now.tv_nsec - g_stop_time.tv_nsec) / 1e6);
+        unlink(state->control_file);
+        if (state->journal_enabled) close_journal(state);
+        close_logger(state);
+        detach_shm(state);
+        cleanup_ipc();
+        return 0;
+    }
     
     std::cout << "\n[MAIN] All processes finished. Cleaning up IPC resources..." << std::endl;
     
+    flush_proc_stats(state);
+    getrusage(RUSAGE_SELF, &ru);
+    account_rusage(state->role_stats[CAT_MAIN], ru);
+    report_role_stats(state);
+    if (state->trace_enabled) write_trace(state);
+    if (state->journal_enabled) close_journal(state);
+    
+    for (int i = SEM_STATE; i <= SEM_SHIP; i++) {
+        const LockStats& ls = state->lock_stats[i];
+        log_msg<LOG_INFO>(state, "Lock %-12s %8ld acquisitions, %6ld contended (%.1f%%), %.3f ms waiting",
+                          sem_name(i), ls.acquisitions, ls.contended,
+                          ls.acquisitions ? 100.0 * ls.contended / ls.acquisitions : 0.0, ls.wait_ns / 1e6);
+    }
+    if (state->log_drops > 0)
+        log_msg<LOG_WARN>(state, "Dropped %ld log lines", state->log_drops);
+    g_state = nullptr;
+    unlink(state->control_file);
+    close_logger(state);
     detach_shm(state);
     cleanup_ipc();
     
@@ -1,57 +1,29 @@
 #include "common.h"
 #include "ipc.h"
 #include "logger.h"
+#include "journal.h"
+#include "phase.h"
+#include "pier_queue.h"
 #include <cstdlib>
 
 SharedState* state;
-int sem_id, msg_id;
+int sem_id;
 int my_id;
-bool has_bike;
+RiderKind kind;
+uint64_t bridge_cost, ship_cost;
 
 void remove_from_queue() {
-    int* queue;
-    int* size;
-    
-    if (state->passenger_location[my_id] == TYNIEC) {
-        queue = state->queue_tyniec;
-        size = &state->queue_tyniec_size;
-    } else {
-        queue = state->queue_wawel;
-        size = &state->queue_wawel_size;
-    }
-    
-    for (int i = 0; i < *size; i++) {
-        if (queue[i] == my_id) {
-            for (int j = i; j < *size - 1; j++)
-                queue[j] = queue[j + 1];
-            (*size)--;
-            break;
-        }
-    }
+    queue_remove(state, rider_location(state, my_id), my_id);
 }
 
+// Back to the place it had before stepping on the bridge
 void add_to_queue_front() {
-    int* queue;
-    int* size;
-    
-    if (state->passenger_location[my_id] == TYNIEC) {
-        queue = state->queue_tyniec;
-        size = &state->queue_tyniec_size;
-    } else {
-        queue = state->queue_wawel;
-        size = &state->queue_wawel_size;
-    }
-    
-    for (int i = *size; i > 0; i--)
-        queue[i] = queue[i - 1];
-    queue[0] = my_id;
-    (*size)++;
+    queue_restore(state, rider_location(state, my_id), my_id);
 }
 
 void add_to_bridge() {
     state->bridge_queue[state->bridge_size++] = my_id;
-    int slots = has_bike ? 2 : 1;
-    state->bridge_count += slots;
+    state->used += bridge_cost;
 }
 
 void remove_from_bridge() {
@@ -63,14 +35,12 @@ void remove_from_bridge() {
             break;
         }
     }
-    int slots = has_bike ? 2 : 1;
-    state->bridge_count -= slots;
+    state->used -= bridge_cost;
 }
 
 void add_to_ship() {
     state->ship_passengers[state->ship_count++] = my_id;
-    state->ship_people++;
-    if (has_bike) state->ship_bikes++;
+    state->used += ship_cost;
 }
 
 void remove_from_ship() {
@@ -82,130 +52,197 @@ void remove_from_ship() {
             break;
         }
     }
-    state->ship_people--;
-    if (has_bike) state->ship_bikes--;
+    state->used -= ship_cost;
 }
 
-char name_buf[16];
-const char* my_name() {
-    snprintf(name_buf, sizeof(name_buf), "P%d%s", my_id, has_bike ? "B" : "");
-    return name_buf;
+// Called after dropping locks: a full ring makes the push wait for the captain
+void notify_captain(RiderEventType type) {
+    ring_push(&state->event_ring, type, my_id, state->captain_efd);
+    notify_eventfd(state->captain_efd);
 }
 
-int main(int argc, char* argv[]) {
-    if (argc != 2) return 1;
+// After the dwell at the destination the rider queues there for the next leg,
+// unless the day has moved on meanwhile (the captain re-queues everyone then)
+void rejoin_queue(int day) {
+    bool rejoined = false;
+    usleep(state->destination_dwell * 1000);
+    Location loc = rider_location(state, my_id);
+    int queue_sem = queue_lock(loc);
+    sem_lock(sem_id, queue_sem);
+    sem_lock(sem_id, SEM_BRIDGE);
     
-    my_id = atoi(argv[1]);
-    
-    int shm_id = get_shm();
-    sem_id = get_sem();
-    msg_id = get_msgq();
-    state = attach_shm(shm_id);
+    if (state->day == day && state->phase != PHASE_END && rider_state(state, my_id) == STATE_EXITED) {
+        seq_write_begin(&state->state_seq);
+        set_rider_state(state, my_id, STATE_QUEUE);
+        queue_push(state, loc, my_id);
+        state->riders_rejoined++;
+        seq_write_end(&state->state_seq);
+        rejoined = true;
+        log_msg<LOG_DEBUG>(state, "Rejoined queue");
+        journal_event(state, EV_REJOIN, my_id, loc);
+    }
     
-    has_bike = state->passenger_has_bike[my_id];
+    sem_unlock(sem_id, SEM_BRIDGE);
+    sem_unlock(sem_id, queue_sem);
+    if (rejoined) notify_captain(RIDER_REJOINED);
+}
+
+template <typename Shape>
+void ride() {
+    bridge_cost = Shape::cost(*state, kind) & RES_BRIDGE_LANE;
+    ship_cost = Shape::cost(*state, kind) & RES_SHIP_LANES;
     
     while (true) {
-        sem_lock(sem_id, SEM_PASSENGER_BASE + my_id);
+        futex_sem_wait(&state->passenger_wake[my_id]);
         
-        sem_lock(sem_id, SEM_MUTEX);
+        // The wake post orders this read after the captain's phase change
+        Phase phase = __atomic_load_n(&state->phase, __ATOMIC_ACQUIRE);
+        PassengerState my_state = rider_state(state, my_id);
+        int queue_sem = queue_lock(rider_location(state, my_id));
         
-        if (state->phase == PHASE_END) {
-            sem_unlock(sem_id, SEM_MUTEX);
-            break;
-        }
-        
-        if (state->passenger_state[my_id] == STATE_EXITED) {
-            sem_unlock(sem_id, SEM_MUTEX);
-            break;
-        }
-        
-        Phase phase = state->phase;
-        int my_state = state->passenger_state[my_id];
+        if (phase == PHASE_END) break;
         
         if (phase == PHASE_LOADING && my_state == STATE_QUEUE) {
-            sem_unlock(sem_id, SEM_MUTEX);
             usleep(state->queue_to_bridge_time * 1000);
-            sem_lock(sem_id, SEM_MUTEX);
+            sem_lock(sem_id, queue_sem);
+            sem_lock(sem_id, SEM_BRIDGE);
+            
+            // Loading may have closed during the walk; then the rider keeps its place
+            if (state->loading_done || state->ship_location != rider_location(state, my_id)) {
+                sem_unlock(sem_id, SEM_BRIDGE);
+                sem_unlock(sem_id, queue_sem);
+                log_msg<LOG_DEBUG>(state, "Loading closed, staying in queue");
+                continue;
+            }
             
+            seq_write_begin(&state->state_seq);
             remove_from_queue();
             add_to_bridge();
-            state->passenger_state[my_id] = STATE_BRIDGE;
-            log_msg(state, my_name(), "Entered bridge");
-            send_msg(msg_id, MSG_ACK, my_id);
+            set_rider_state(state, my_id, STATE_BRIDGE);
+            seq_write_end(&state->state_seq);
+            log_msg<LOG_DEBUG>(state, "Entered bridge");
+            journal_event(state, EV_ADMIT, my_id, state->ship_location);
             
-            sem_unlock(sem_id, SEM_MUTEX);
+            sem_unlock(sem_id, SEM_BRIDGE);
+            sem_unlock(sem_id, queue_sem);
+            notify_captain(RIDER_ENTERED_BRIDGE);
             continue;
         }
         
         if (phase == PHASE_LOADING && my_state == STATE_BRIDGE) {
-            sem_unlock(sem_id, SEM_MUTEX);
             usleep(state->bridge_to_ship_time * 1000);
-            sem_lock(sem_id, SEM_MUTEX);
+            sem_lock(sem_id, SEM_BRIDGE);
+            sem_lock(sem_id, SEM_SHIP);
             
-            if (state->phase != PHASE_LOADING || 
-                state->ship_people >= state->ship_capacity_people ||
-                (has_bike && state->ship_bikes >= state->ship_capacity_bikes)) {
-                sem_unlock(sem_id, SEM_MUTEX);
+            if (state->phase != PHASE_LOADING || state->loading_done || !can_board_ship<Shape>(*state, kind)) {
+                sem_unlock(sem_id, SEM_SHIP);
+                sem_unlock(sem_id, SEM_BRIDGE);
                 continue;
             }
             
+            seq_write_begin(&state->state_seq);
             remove_from_bridge();
             add_to_ship();
-            state->passenger_state[my_id] = STATE_SHIP;
-            log_msg(state, my_name(), "Entered ship");
-            send_msg(msg_id, MSG_ACK, my_id);
+            set_rider_state(state, my_id, STATE_SHIP);
+            seq_write_end(&state->state_seq);
+            log_msg<LOG_DEBUG>(state, "Entered ship");
+            journal_event(state, EV_BOARD, my_id, state->ship_location);
             
-            sem_unlock(sem_id, SEM_MUTEX);
+            sem_unlock(sem_id, SEM_SHIP);
+            sem_unlock(sem_id, SEM_BRIDGE);
+            notify_captain(RIDER_BOARDED);
             continue;
         }
         
         if (phase == PHASE_BRIDGE_CLEAR && my_state == STATE_BRIDGE) {
-            sem_unlock(sem_id, SEM_MUTEX);
             usleep(state->queue_to_bridge_time * 1000);
-            sem_lock(sem_id, SEM_MUTEX);
+            sem_lock(sem_id, queue_sem);
+            sem_lock(sem_id, SEM_BRIDGE);
             
+            seq_write_begin(&state->state_seq);
             remove_from_bridge();
             add_to_queue_front();
-            state->passenger_state[my_id] = STATE_QUEUE;
-            log_msg(state, my_name(), "Left bridge (returned to queue)");
-            send_msg(msg_id, MSG_ACK, my_id);
+            set_rider_state(state, my_id, STATE_QUEUE);
+            seq_write_end(&state->state_seq);
+            log_msg<LOG_DEBUG>(state, "Left bridge (returned to queue)");
+            journal_event(state, EV_RETURN, my_id, state->ship_location);
             
-            sem_unlock(sem_id, SEM_MUTEX);
+            sem_unlock(sem_id, SEM_BRIDGE);
+            sem_unlock(sem_id, queue_sem);
+            notify_captain(RIDER_RETURNED_TO_QUEUE);
             continue;
         }
         
         if (phase == PHASE_UNLOADING && my_state == STATE_SHIP) {
-            sem_unlock(sem_id, SEM_MUTEX);
             usleep(state->ship_to_bridge_time * 1000);
-            sem_lock(sem_id, SEM_MUTEX);
+            sem_lock(sem_id, SEM_BRIDGE);
+            sem_lock(sem_id, SEM_SHIP);
             
+            seq_write_begin(&state->state_seq);
             remove_from_ship();
             add_to_bridge();
-            state->passenger_state[my_id] = STATE_BRIDGE;
-            log_msg(state, my_name(), "Disembarked to bridge");
-            send_msg(msg_id, MSG_ACK, my_id);
+            set_rider_state(state, my_id, STATE_BRIDGE);
+            seq_write_end(&state->state_seq);
+            log_msg<LOG_DEBUG>(state, "Disembarked to bridge");
+            journal_event(state, EV_DISEMBARK, my_id, state->ship_location);
             
-            sem_unlock(sem_id, SEM_MUTEX);
+            sem_unlock(sem_id, SEM_SHIP);
+            sem_unlock(sem_id, SEM_BRIDGE);
+            notify_captain(RIDER_DISEMBARKED);
             continue;
         }
         
         if (phase == PHASE_UNLOADING && my_state == STATE_BRIDGE) {
-            sem_unlock(sem_id, SEM_MUTEX);
             usleep(state->bridge_to_exit_time * 1000);
-            sem_lock(sem_id, SEM_MUTEX);
+            sem_lock(sem_id, SEM_BRIDGE);
             
+            seq_write_begin(&state->state_seq);
             remove_from_bridge();
-            state->passenger_state[my_id] = STATE_EXITED;
-            log_msg(state, my_name(), "Left bridge");
-            send_msg(msg_id, MSG_ACK, my_id);
+            set_rider_state(state, my_id, STATE_EXITED);
+            state->riders_exited++;
+            if (rider_location(state, my_id) != state->ship_location) {
+                state->day_delivered++;
+                state->riders_delivered++;
+            }
+            set_rider_location(state, my_id, state->ship_location);
+            bool next_leg = ++state->passenger_legs[my_id] < state->rider_trips;
+            int day = state->day;
+            seq_write_end(&state->state_seq);
+            log_msg<LOG_DEBUG>(state, "Left bridge");
+            journal_event(state, EV_EXIT, my_id, state->ship_location);
             
-            sem_unlock(sem_id, SEM_MUTEX);
-            break;
+            sem_unlock(sem_id, SEM_BRIDGE);
+            notify_captain(RIDER_EXITED);
+            if (next_leg) rejoin_queue(day);
+            continue;
         }
-        
-        sem_unlock(sem_id, SEM_MUTEX);
     }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) return 1;
+    
+    my_id = atoi(argv[1]);
+    
+    int shm_id = get_shm();
+    sem_id = get_sem();
+    state = attach_shm(shm_id);
+    track_lock_stats(state->lock_stats);
+    
+    kind = rider_kind(state, my_id);
+    
+    char name[16];
+    snprintf(name, sizeof(name), "P%d%s", my_id, kind_tag(kind));
+    set_log_source(CAT_PASSENGER, name);
+    
+#ifdef TRAM_FIXED
+    if (state->fixed_shape) ride<CompiledShape>();
+    else ride<RuntimeShape>();
+#else
+    ride<RuntimeShape>();
+#endif
     
+    flush_proc_stats(state);
     detach_shm(state);
     return 0;
 }
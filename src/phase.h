@@ -0,0 +1,114 @@
+#ifndef PHASE_H
+#define PHASE_H
+
+#include "common.h"
+
+// Captain decision rules shared by the live captain and the planner's
+// simulated captain. S is SharedState or any struct with the same fields.
+
+enum LoadingOutcome {
+    LOAD_CONTINUE = 0,
+    LOAD_SIGNAL2,
+    LOAD_SIGNAL1,
+    LOAD_T1_EXPIRED,
+    LOAD_SHIP_FULL
+};
+
+enum DeparturePolicy {
+    DEPART_FIXED = 0,
+    DEPART_ADAPTIVE = 1
+};
+
+// used + cost <= cap in every 16-bit lane at once. Lanes hold at most
+// RES_LANE_MAX plus a small cost, so no lane borrows from its neighbour and
+// each guard bit survives exactly when its lane fits.
+#define RES_GUARD 0x8000800080008000ULL
+
+inline bool res_fits(uint64_t used, uint64_t cost, uint64_t cap) {
+    return (((cap | RES_GUARD) - (used + cost)) & RES_GUARD) == RES_GUARD;
+}
+
+// Where capacities and kind costs come from. RuntimeShape reads them from
+// the state; a fixed build (TRAM_FIXED_CONFIG) bakes them in as constants,
+// and only the kinds that have riders are checked.
+struct RuntimeShape {
+    static constexpr unsigned kinds = (1u << RIDER_KINDS) - 1;
+    template <typename S> static uint64_t capacity(const S& s) { return s.capacity; }
+    template <typename S> static uint64_t cost(const S& s, int kind) { return s.kind_cost[kind]; }
+};
+
+template <uint64_t Capacity, unsigned Kinds, uint64_t... Costs>
+struct FixedShape {
+    static constexpr unsigned kinds = Kinds;
+    static constexpr uint64_t costs[RIDER_KINDS] = {Costs...};
+    template <typename S> static constexpr uint64_t capacity(const S&) { return Capacity; }
+    template <typename S> static constexpr uint64_t cost(const S&, int kind) { return costs[kind]; }
+};
+
+#ifdef TRAM_FIXED
+using CompiledShape = FixedShape<TRAM_FIXED_CAPACITY, TRAM_FIXED_KINDS, TRAM_FIXED_COSTS>;
+
+// The baked-in constants only apply when the loaded config has the same shape;
+// a kind outside the compiled mask would never fit the bridge, so it forces the runtime path
+template <typename S>
+inline bool compiled_shape_matches(const S& s, unsigned kinds) {
+    if (kinds & ~CompiledShape::kinds) return false;
+    if (s.capacity != TRAM_FIXED_CAPACITY) return false;
+    for (int k = 0; k < RIDER_KINDS; k++)
+        if ((CompiledShape::kinds >> k & 1) && s.kind_cost[k] != CompiledShape::costs[k]) return false;
+    return true;
+}
+#endif
+
+template <typename Shape = RuntimeShape, typename S>
+inline int bridge_slots(const S& s, int kind) {
+    return (int)(Shape::cost(s, kind) & RES_BRIDGE_LANE);
+}
+
+template <typename Shape = RuntimeShape, typename S>
+inline bool can_board_ship(const S& s, int kind) {
+    return res_fits(s.used, Shape::cost(s, kind) & RES_SHIP_LANES, Shape::capacity(s));
+}
+
+template <typename Shape = RuntimeShape, typename S>
+inline bool can_enter_bridge(const S& s, int kind) {
+    return res_fits(s.used, Shape::cost(s, kind) & RES_BRIDGE_LANE, Shape::capacity(s));
+}
+
+// Bit k is set when a rider of kind k would fit on the bridge right now
+template <typename Shape = RuntimeShape, typename S>
+inline unsigned bridge_fit_mask(const S& s) {
+    unsigned mask = 0;
+    for (int k = 0; k < RIDER_KINDS; k++)
+        if (Shape::kinds >> k & 1) mask |= (unsigned)can_enter_bridge<Shape>(s, k) << k;
+    return mask;
+}
+
+// Longest the ship may stay at a pier: T1, or MAX_DWELL in adaptive mode
+template <typename S>
+inline long loading_deadline(const S& s) {
+    return s.departure_policy == DEPART_ADAPTIVE ? s.max_dwell : s.t1;
+}
+
+template <typename Shape = RuntimeShape, typename S>
+inline LoadingOutcome loading_outcome(const S& s, long elapsed_ms) {
+    if (s.signal2) return LOAD_SIGNAL2;
+    if (s.signal1) return LOAD_SIGNAL1;
+    if (elapsed_ms >= loading_deadline(s)) return LOAD_T1_EXPIRED;
+    if (s.ship_people >= res_lane(Shape::capacity(s), LANE_PEOPLE)) return LOAD_SHIP_FULL;
+    return LOAD_CONTINUE;
+}
+
+// Adaptive mode, once MIN_DWELL has passed and nobody is left to board here:
+// waiting one more ms spares each rider who turns up in it a round trip
+// (2*T2), but delays everyone on board and everyone queued across the river.
+template <typename S>
+inline bool adaptive_departure(const S& s, long elapsed_ms, int here_waiting, int there_waiting,
+                               double here_per_ms, double there_per_ms) {
+    if (elapsed_ms < s.min_dwell || here_waiting > 0) return false;
+    double next_visit = here_per_ms * 2.0 * s.t2;
+    if (next_visit >= s.ship_capacity_people) return true;
+    return next_visit <= s.ship_people + there_waiting + there_per_ms * s.t2;
+}
+
+#endif
@@ -0,0 +1,79 @@
+#include "pier_queue.h"
+
+static bool before(const SharedState* state, int a, int b) {
+    long ka = state->passenger_queue_key[a], kb = state->passenger_queue_key[b];
+    return ka < kb || (ka == kb && a < b);
+}
+
+static void place(SharedState* state, int* heap, int i, int pid) {
+    heap[i] = pid;
+    state->passenger_queue_pos[pid] = i;
+}
+
+static void sift_up(SharedState* state, int* heap, int i) {
+    int pid = heap[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!before(state, pid, heap[parent])) break;
+        place(state, heap, i, heap[parent]);
+        i = parent;
+    }
+    place(state, heap, i, pid);
+}
+
+static void sift_down(SharedState* state, int* heap, int size, int i) {
+    int pid = heap[i];
+    while (true) {
+        int child = 2 * i + 1;
+        if (child >= size) break;
+        if (child + 1 < size && before(state, heap[child + 1], heap[child])) child++;
+        if (!before(state, heap[child], pid)) break;
+        place(state, heap, i, heap[child]);
+        i = child;
+    }
+    place(state, heap, i, pid);
+}
+
+// New arrival: behind everyone already queued in its class
+void queue_push(SharedState* state, Location loc, int pid) {
+    PierQueue& q = state->piers[loc];
+    state->passenger_queue_key[pid] = q.next_seq++ - (long)rider_class(state, pid) * state->priority_skip;
+    queue_restore(state, loc, pid);
+}
+
+// Back into the queue with the key it had, e.g. after a bridge clear
+void queue_restore(SharedState* state, Location loc, int pid) {
+    PierQueue& q = state->piers[loc];
+    int l = rider_kind(state, pid);
+    int i = q.size[l]++;
+    place(state, q.heap[l], i, pid);
+    sift_up(state, q.heap[l], i);
+}
+
+void queue_remove(SharedState* state, Location loc, int pid) {
+    PierQueue& q = state->piers[loc];
+    int l = rider_kind(state, pid);
+    int* heap = q.heap[l];
+    int i = state->passenger_queue_pos[pid];
+    if (i >= q.size[l] || heap[i] != pid) return;
+    
+    int last = heap[--q.size[l]];
+    if (i == q.size[l]) return;
+    place(state, heap, i, last);
+    if (i > 0 && before(state, last, heap[(i - 1) / 2]))
+        sift_up(state, heap, i);
+    else
+        sift_down(state, heap, q.size[l], i);
+}
+
+// Next rider in line among the kinds set in fit_mask; -1 if none
+int queue_peek(const SharedState* state, Location loc, unsigned fit_mask) {
+    const PierQueue& q = state->piers[loc];
+    int best = -1;
+    for (int k = 0; k < RIDER_KINDS; k++) {
+        if (!(fit_mask >> k & 1) || !q.size[k]) continue;
+        int head = q.heap[k][0];
+        if (best < 0 || before(state, head, best)) best = head;
+    }
+    return best;
+}
@@ -0,0 +1,15 @@
+#ifndef PIER_QUEUE_H
+#define PIER_QUEUE_H
+
+#include "common.h"
+
+// Heap-backed pier queues; callers hold the pier's SEM_QUEUE lock.
+// A rider's key is its arrival number at the pier minus class * PRIORITY_SKIP,
+// so a higher class overtakes at most PRIORITY_SKIP riders per class step.
+
+void queue_push(SharedState* state, Location loc, int pid);
+void queue_restore(SharedState* state, Location loc, int pid);
+void queue_remove(SharedState* state, Location loc, int pid);
+int queue_peek(const SharedState* state, Location loc, unsigned fit_mask);
+
+#endif
@@ -0,0 +1,519 @@
+#include "common.h"
+#include "config.h"
+#include "phase.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <climits>
+
+struct DemandSegment {
+    double start_ms;
+    double end_ms;
+    double rate_per_min[2];
+    double bike_share;
+};
+
+struct RangeParam {
+    std::string key;
+    std::vector<int> values;
+};
+
+struct SimRider {
+    long arrival_ms;
+    int kind;
+};
+
+struct BridgeRider {
+    SimRider rider;
+    long ready_ms;
+    bool boarding;
+};
+
+// Field names mirror SharedState so the phase.h rules apply unchanged
+struct SimState {
+    union {
+        uint64_t used;
+        struct { uint16_t bridge_count, ship_people, ship_bikes, ship_spaces; };
+    };
+    union {
+        uint64_t capacity;
+        struct { uint16_t bridge_capacity, ship_capacity_people, ship_capacity_bikes, ship_capacity_spaces; };
+    };
+    uint64_t kind_cost[RIDER_KINDS];
+    int t1;
+    int t2;
+    int departure_policy;
+    int min_dwell;
+    int max_dwell;
+    bool signal1;
+    bool signal2;
+};
+
+struct DayResult {
+    int delivered;
+    int left_waiting;
+    long end_ms;
+    std::vector<int> waits_ms;
+    std::vector<long> unserved_ms;
+};
+
+// Waiting summed over every rider of the day, with those never carried counted up to `horizon`
+static double rider_minutes(const DayResult& d, long horizon) {
+    double ms = 0;
+    for (int w : d.waits_ms) ms += w;
+    for (long a : d.unserved_ms)
+        if (a < horizon) ms += horizon - a;
+    return ms / 60000.0;
+}
+
+struct PlanResult {
+    Config cfg;
+    double riders_per_day;
+    double left_waiting;
+    int wait_p50;
+    int wait_p90;
+    int wait_p99;
+    double saved_min;
+    bool pareto;
+};
+
+// Totals over one run of consecutive days of one config, merged into its PlanResult
+struct PlanChunk {
+    long delivered;
+    long left;
+    double saved;
+    std::vector<int> waits;
+};
+
+class DaySim {
+public:
+    DaySim(const Config& cfg, const std::vector<DemandSegment>& demand, uint64_t seed)
+        : cfg(cfg), demand(demand), rng(seed) {
+        s = {};
+        s.capacity = res_vec(cfg.K, cfg.N, cfg.M, cfg.spaces);
+        for (int kind = 0; kind < RIDER_KINDS; kind++) s.kind_cost[kind] = kind_cost(cfg, kind);
+        s.t1 = cfg.T1;
+        s.t2 = cfg.T2;
+        s.departure_policy = cfg.departure;
+        s.min_dwell = cfg.min_dwell;
+        s.max_dwell = effective_max_dwell(cfg);
+
+        for (int loc = 0; loc < 2; loc++)
+            for (int kind = 0; kind < RIDER_KINDS; kind++)
+                for (int i = 0; i < pier_riders(cfg, loc, kind); i++) arrivals[loc].push_back({0, kind});
+
+        std::uniform_real_distribution<double> uni(0.0, 1.0);
+        for (const DemandSegment& seg : demand) {
+            for (int loc = 0; loc < 2; loc++) {
+                if (seg.rate_per_min[loc] <= 0) continue;
+                std::exponential_distribution<double> gap(seg.rate_per_min[loc] / 60000.0);
+                for (double t = seg.start_ms + gap(rng); t < seg.end_ms; t += gap(rng))
+                    arrivals[loc].push_back({(long)t, uni(rng) < seg.bike_share ? KIND_BIKE : KIND_WALKER});
+            }
+        }
+        for (int loc = 0; loc < 2; loc++) {
+            std::stable_sort(arrivals[loc].begin(), arrivals[loc].end(),
+                             [](const SimRider& a, const SimRider& b) { return a.arrival_ms < b.arrival_ms; });
+            next_arrival[loc] = 0;
+        }
+    }
+
+    DayResult run() {
+        Location loc = TYNIEC;
+        long t = 0;
+        for (int trip = 0; trip < cfg.R; trip++) {
+            t = load(loc, t);
+            t = clear_bridge(loc, t);
+            t += cfg.T2;
+            loc = (loc == TYNIEC) ? WAWEL : TYNIEC;
+            t = unload(t);
+        }
+        for (int l = 0; l < 2; l++) {
+            admit_arrivals((Location)l, t);
+            result.left_waiting += (int)queue[l].size();
+            for (const SimRider& r : queue[l]) result.unserved_ms.push_back(r.arrival_ms);
+            for (size_t i = next_arrival[l]; i < arrivals[l].size(); i++)
+                result.unserved_ms.push_back(arrivals[l][i].arrival_ms);
+        }
+        result.end_ms = t;
+        return result;
+    }
+
+private:
+    const Config& cfg;
+    const std::vector<DemandSegment>& demand;
+    std::mt19937_64 rng;
+    SimState s;
+    std::vector<SimRider> arrivals[2];
+    size_t next_arrival[2];
+    std::deque<SimRider> queue[2];
+    std::vector<BridgeRider> bridge;
+    std::vector<SimRider> ship;
+    DayResult result = {};
+
+    void admit_arrivals(Location loc, long t) {
+        while (next_arrival[loc] < arrivals[loc].size() && arrivals[loc][next_arrival[loc]].arrival_ms <= t)
+            queue[loc].push_back(arrivals[loc][next_arrival[loc]++]);
+    }
+
+    long next_arrival_ms(Location loc) {
+        return next_arrival[loc] < arrivals[loc].size() ? arrivals[loc][next_arrival[loc]].arrival_ms : LONG_MAX;
+    }
+
+    // Expected arrivals per ms from the demand profile; stands in for a measured recent rate
+    double arrival_rate(Location loc, long t) {
+        double rate = 0;
+        for (const DemandSegment& seg : demand)
+            if (t >= seg.start_ms && t < seg.end_ms) rate += seg.rate_per_min[loc];
+        return rate / 60000.0;
+    }
+
+    long load(Location loc, long start) {
+        long t = start;
+        bool admitting = false;
+        long admit_done = 0;
+        SimRider admitted = {};
+
+        while (true) {
+            admit_arrivals(loc, t);
+
+            for (BridgeRider& b : bridge) {
+                if (b.boarding && b.ready_ms <= t) {
+                    b.boarding = false;
+                    if (!can_board_ship(s, b.rider.kind)) continue;
+                    s.used -= s.kind_cost[b.rider.kind] & RES_BRIDGE_LANE;
+                    s.used += s.kind_cost[b.rider.kind] & RES_SHIP_LANES;
+                    ship.push_back(b.rider);
+                    result.waits_ms.push_back((int)(b.ready_ms - b.rider.arrival_ms));
+                    b.rider.arrival_ms = -1;
+                }
+            }
+            bridge.erase(std::remove_if(bridge.begin(), bridge.end(),
+                                        [](const BridgeRider& b) { return b.rider.arrival_ms < 0; }),
+                         bridge.end());
+
+            if (admitting && admit_done <= t) {
+                admitting = false;
+                s.bridge_count += bridge_slots(s, admitted.kind);
+                bridge.push_back({admitted, t + cfg.bridge_to_ship_time, can_board_ship(s, admitted.kind)});
+            }
+
+            if (!admitting) {
+                if (loading_outcome(s, t - start) != LOAD_CONTINUE) break;
+
+                auto it = std::find_if(queue[loc].begin(), queue[loc].end(),
+                                       [&](const SimRider& r) { return can_enter_bridge(s, r.kind); });
+                if (it != queue[loc].end()) {
+                    admitted = *it;
+                    queue[loc].erase(it);
+                    admitting = true;
+                    admit_done = t + cfg.queue_to_bridge_time;
+                } else if (s.departure_policy == DEPART_ADAPTIVE) {
+                    Location across = (loc == TYNIEC) ? WAWEL : TYNIEC;
+                    admit_arrivals(across, t);
+                    if (adaptive_departure(s, t - start, (int)(queue[loc].size() + bridge.size()),
+                                           (int)queue[across].size(), arrival_rate(loc, t),
+                                           arrival_rate(across, t)))
+                        break;
+                } else if (queue[loc].empty() && bridge.empty()) {
+                    break;
+                }
+            }
+
+            long next = admitting ? admit_done : std::min(start + loading_deadline(s), next_arrival_ms(loc));
+            if (!admitting && s.departure_policy == DEPART_ADAPTIVE) {
+                next = std::min(next, next_arrival_ms(loc == TYNIEC ? WAWEL : TYNIEC));
+                if (t < start + s.min_dwell) next = std::min(next, start + (long)s.min_dwell);
+            }
+            for (const BridgeRider& b : bridge)
+                if (b.boarding) next = std::min(next, b.ready_ms);
+            t = std::max(t, next);
+        }
+        return t;
+    }
+
+    long clear_bridge(Location loc, long t) {
+        for (auto it = bridge.rbegin(); it != bridge.rend(); ++it) {
+            t += cfg.queue_to_bridge_time;
+            queue[loc].push_front(it->rider);
+        }
+        bridge.clear();
+        s.bridge_count = 0;
+        return t;
+    }
+
+    long unload(long t) {
+        std::vector<std::pair<long, int>> leaving;
+        size_t next = 0;
+        long last_exit = t;
+
+        while (next < ship.size()) {
+            leaving.erase(std::remove_if(leaving.begin(), leaving.end(),
+                                         [&](const std::pair<long, int>& e) {
+                                             if (e.first > t) return false;
+                                             s.bridge_count -= bridge_slots(s, e.second);
+                                             return true;
+                                         }),
+                          leaving.end());
+
+            int kind = ship[next].kind;
+            if (can_enter_bridge(s, kind)) {
+                t += cfg.ship_to_bridge_time;
+                s.bridge_count += bridge_slots(s, kind);
+                leaving.push_back({t + cfg.bridge_to_exit_time, kind});
+                last_exit = std::max(last_exit, t + cfg.bridge_to_exit_time);
+                result.delivered++;
+                next++;
+            } else {
+                long earliest = LONG_MAX;
+                for (const auto& e : leaving) earliest = std::min(earliest, e.first);
+                t = earliest;
+            }
+        }
+
+        ship.clear();
+        s.used = 0;
+        return std::max(t, last_exit);
+    }
+};
+
+static bool parse_ranges(const char* filename, std::vector<RangeParam>& params) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Error: Cannot open ranges file: " << filename << std::endl;
+        return false;
+    }
+
+    Config probe = {};
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t comment_pos = line.find('#');
+        if (comment_pos != std::string::npos) line = line.substr(0, comment_pos);
+        size_t eq_pos = line.find('=');
+        if (eq_pos == std::string::npos) continue;
+
+        std::string key, value;
+        std::istringstream(line.substr(0, eq_pos)) >> key;
+        std::istringstream(line.substr(eq_pos + 1)) >> value;
+        if (key.empty() || value.empty()) continue;
+
+        if (!config_field(probe, key)) {
+            std::cerr << "Error: Unknown config field in ranges: " << key << std::endl;
+            return false;
+        }
+
+        RangeParam p;
+        p.key = key;
+        int lo, hi, step = 1;
+        char c;
+        std::istringstream vs(value);
+        if (value.find("..") != std::string::npos) {
+            if (!(vs >> lo >> c >> c >> hi) || (vs >> c && c == ':' && !(vs >> step)) || step <= 0 || hi < lo) {
+                std::cerr << "Error: Invalid range for " << key << ": " << value << std::endl;
+                return false;
+            }
+            for (int v = lo; v <= hi; v += step) p.values.push_back(v);
+        } else {
+            std::string item;
+            while (std::getline(vs, item, ',')) {
+                try {
+                    p.values.push_back(std::stoi(item));
+                } catch (...) {
+                    std::cerr << "Error: Invalid value for " << key << ": " << item << std::endl;
+                    return false;
+                }
+            }
+        }
+        params.push_back(p);
+    }
+    return true;
+}
+
+static bool parse_demand(const char* filename, std::vector<DemandSegment>& demand) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Error: Cannot open demand profile: " << filename << std::endl;
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t comment_pos = line.find('#');
+        if (comment_pos != std::string::npos) line = line.substr(0, comment_pos);
+        std::istringstream ls(line);
+        double start_min, end_min;
+        DemandSegment seg;
+        if (!(ls >> start_min)) continue;
+        if (!(ls >> end_min >> seg.rate_per_min[TYNIEC] >> seg.rate_per_min[WAWEL] >> seg.bike_share) ||
+            end_min < start_min || seg.bike_share < 0 || seg.bike_share > 1) {
+            std::cerr << "Error: Invalid demand line: " << line << std::endl;
+            return false;
+        }
+        seg.start_ms = start_min * 60000.0;
+        seg.end_ms = end_min * 60000.0;
+        demand.push_back(seg);
+    }
+    return true;
+}
+
+// Same rules as the simulation enforces, minus the process limit; rejected points are skipped quietly
+static bool plan_config_valid(const Config& c) {
+    std::ostringstream ignored;
+    return check_config(c, ignored);
+}
+
+static int percentile(const std::vector<int>& v, int p) {
+    if (v.empty()) return 0;
+    return v[(v.size() - 1) * p / 100];
+}
+
+static void print_result(const PlanResult& r) {
+    printf("%5d %4d %4d %7d %7d %4d %10.1f %8.1f %8d %8d %8d",
+           r.cfg.N, r.cfg.M, r.cfg.K, r.cfg.T1, r.cfg.T2, r.cfg.R,
+           r.riders_per_day, r.left_waiting, r.wait_p50, r.wait_p90, r.wait_p99);
+    if (r.cfg.departure == DEPART_ADAPTIVE) printf(" %10.1f", r.saved_min);
+    printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4 || argc > 6) {
+        std::cerr << "Usage: " << argv[0] << " <base.env> <ranges.env> <demand.txt> [days] [seed]" << std::endl;
+        return 1;
+    }
+
+    Config base;
+    if (!load_config(argv[1], base)) return 1;
+
+    std::vector<RangeParam> params;
+    std::vector<DemandSegment> demand;
+    if (!parse_ranges(argv[2], params)) return 1;
+    if (!parse_demand(argv[3], demand)) return 1;
+
+    int days = argc > 4 ? atoi(argv[4]) : 1000;
+    uint64_t seed = argc > 5 ? strtoull(argv[5], nullptr, 10) : 1;
+    if (days <= 0) {
+        std::cerr << "Error: days must be positive" << std::endl;
+        return 1;
+    }
+
+    std::vector<Config> candidates(1, base);
+    for (const RangeParam& p : params) {
+        std::vector<Config> next;
+        for (const Config& c : candidates) {
+            for (int v : p.values) {
+                Config n = c;
+                *config_field(n, p.key) = v;
+                next.push_back(n);
+            }
+        }
+        candidates.swap(next);
+    }
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                    [](const Config& c) { return !plan_config_valid(c); }),
+                     candidates.end());
+    if (candidates.empty()) {
+        std::cerr << "Error: No valid configurations in ranges" << std::endl;
+        return 1;
+    }
+
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "=== Capacity planner ===" << std::endl;
+    std::cout << candidates.size() << " configurations x " << days << " days on "
+              << threads << " threads (seed " << seed << ")" << std::endl;
+
+    // Each config's days are split into chunks, so a handful of configs still keeps every core busy
+    int chunks = (int)std::min<size_t>(days, (threads * 4 + candidates.size() - 1) / candidates.size());
+    std::vector<PlanChunk> parts(candidates.size() * chunks);
+    std::atomic<size_t> next_job(0);
+    auto worker = [&]() {
+        size_t j;
+        while ((j = next_job.fetch_add(1)) < parts.size()) {
+            const Config& c = candidates[j / chunks];
+            int k = j % chunks;
+            Config fixed = c;
+            fixed.departure = DEPART_FIXED;
+            PlanChunk& part = parts[j];
+            part = PlanChunk{0, 0, 0, {}};
+            for (int d = (long)days * k / chunks; d < (long)days * (k + 1) / chunks; d++) {
+                uint64_t day_seed = seed * 1000003ULL + (uint64_t)d;
+                DaySim sim(c, demand, day_seed);
+                DayResult day = sim.run();
+                part.delivered += day.delivered;
+                part.left += day.left_waiting;
+                part.waits.insert(part.waits.end(), day.waits_ms.begin(), day.waits_ms.end());
+                // Same arrivals under fixed T1, compared over the longer of the two days
+                if (c.departure == DEPART_ADAPTIVE) {
+                    DayResult base_day = DaySim(fixed, demand, day_seed).run();
+                    long horizon = std::max(day.end_ms, base_day.end_ms);
+                    part.saved += rider_minutes(base_day, horizon) - rider_minutes(day, horizon);
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; t++) pool.emplace_back(worker);
+    for (std::thread& t : pool) t.join();
+
+    std::vector<PlanResult> results(candidates.size());
+    for (size_t i = 0; i < candidates.size(); i++) {
+        long delivered = 0, left = 0;
+        double saved = 0;
+        std::vector<int> waits;
+        for (int k = 0; k < chunks; k++) {
+            PlanChunk& part = parts[i * chunks + k];
+            delivered += part.delivered;
+            left += part.left;
+            saved += part.saved;
+            waits.insert(waits.end(), part.waits.begin(), part.waits.end());
+            std::vector<int>().swap(part.waits);
+        }
+        std::sort(waits.begin(), waits.end());
+
+        PlanResult& r = results[i];
+        r.cfg = candidates[i];
+        r.riders_per_day = (double)delivered / days;
+        r.left_waiting = (double)left / days;
+        r.wait_p50 = percentile(waits, 50);
+        r.wait_p90 = percentile(waits, 90);
+        r.wait_p99 = percentile(waits, 99);
+        r.saved_min = saved / days;
+    }
+
+    // Pareto front: more riders per day, lower p90 wait, smaller N+M+K
+    for (PlanResult& a : results) {
+        a.pareto = true;
+        int cap_a = a.cfg.N + a.cfg.M + a.cfg.K;
+        for (const PlanResult& b : results) {
+            int cap_b = b.cfg.N + b.cfg.M + b.cfg.K;
+            bool no_worse = b.riders_per_day >= a.riders_per_day && b.wait_p90 <= a.wait_p90 && cap_b <= cap_a;
+            bool better = b.riders_per_day > a.riders_per_day || b.wait_p90 < a.wait_p90 || cap_b < cap_a;
+            if (no_worse && better) {
+                a.pareto = false;
+                break;
+            }
+        }
+    }
+
+    std::sort(results.begin(), results.end(),
+              [](const PlanResult& a, const PlanResult& b) { return a.riders_per_day > b.riders_per_day; });
+
+    printf("\nPareto-optimal configurations (wait times in ms):\n");
+    if (base.departure == DEPART_ADAPTIVE)
+        printf("Adaptive departure, dwell %d ms..%s; saved = rider-minutes of waiting per day vs fixed T1\n",
+               base.min_dwell, base.max_dwell ? std::to_string(base.max_dwell).append(" ms").c_str() : "T1");
+    printf("%5s %4s %4s %7s %7s %4s %10s %8s %8s %8s %8s",
+           "N", "M", "K", "T1", "T2", "R", "riders/day", "left", "p50", "p90", "p99");
+    if (base.departure == DEPART_ADAPTIVE) printf(" %10s", "saved");
+    printf("\n");
+    for (const PlanResult& r : results)
+        if (r.pareto) print_result(r);
+
+    return 0;
+}
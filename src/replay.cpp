@@ -0,0 +1,274 @@
+#include "journal.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+
+enum ReplayRiderState {
+    R_QUEUE,
+    R_BRIDGE_IN,
+    R_SHIP,
+    R_BRIDGE_OUT,
+    R_EXITED
+};
+
+struct ReplayRider {
+    int kind;
+    int ticket_class;
+    Location origin;
+    Location exit_location;
+    ReplayRiderState st;
+    int deliveries;
+    int total_deliveries;
+    uint64_t queued_us;
+    uint64_t board_time_us;
+    Location home;
+    bool away;
+    uint64_t left_home_us;
+};
+
+struct ReplayState {
+    JournalHeader hdr;
+    std::vector<ReplayRider> riders;
+    Phase phase;
+    Location ship_location;
+    int used[RES_LANES];
+    int trips;
+    int days;
+    int signals1;
+    int signals2;
+    int violations;
+    std::vector<int> trip_loads;
+    std::vector<uint64_t> waits;
+    std::vector<uint64_t> class_waits[RIDER_CLASSES];
+    std::vector<uint64_t> round_trips;
+};
+
+static void violation(ReplayState& rs, const JournalRecord& rec, const char* what) {
+    rs.violations++;
+    if (rs.violations <= 20) {
+        std::cout << "VIOLATION @" << rec.time_us / 1000 << "ms trip " << rec.trip << ": "
+                  << journal_event_name(rec.type) << " P" << rec.pid << " - " << what << std::endl;
+    }
+}
+
+// Adds (sign 1) or releases (sign -1) a rider's cost in every resource lane
+static void take(ReplayState& rs, const JournalRecord& rec, uint64_t cost, int sign) {
+    static const char* over[RES_LANES] = {"bridge over K slots", "ship over N people",
+                                          "ship over M bikes", "ship over SPACES"};
+    for (int lane = 0; lane < RES_LANES; lane++) {
+        rs.used[lane] += sign * res_lane(cost, lane);
+        if (rs.used[lane] > res_lane(rs.hdr.capacity, lane)) violation(rs, rec, over[lane]);
+    }
+}
+
+static void apply(ReplayState& rs, const JournalRecord& rec) {
+    if (rec.type == EV_PHASE) {
+        rs.phase = (Phase)rec.aux;
+        if (rs.phase == PHASE_SAILING) {
+            rs.trips++;
+            rs.trip_loads.push_back(rs.used[LANE_PEOPLE]);
+            rs.ship_location = (rs.ship_location == TYNIEC) ? WAWEL : TYNIEC;
+        }
+        if (rs.phase == PHASE_SAILING && rs.used[LANE_BRIDGE] != 0)
+            violation(rs, rec, "sailing with people on bridge");
+        return;
+    }
+    if (rec.type == EV_DAY) {
+        // Riders who got off start the new day queued at the pier they reached
+        for (ReplayRider& r : rs.riders) {
+            if (r.st == R_BRIDGE_IN || r.st == R_SHIP || r.st == R_BRIDGE_OUT)
+                violation(rs, rec, "rider left on bridge or ship overnight");
+            if (r.st == R_EXITED) {
+                r.st = R_QUEUE;
+                r.origin = r.exit_location;
+            }
+            r.deliveries = 0;
+            r.queued_us = rec.time_us;
+            r.home = r.origin;
+            r.away = false;
+        }
+        rs.days++;
+        return;
+    }
+    if (rec.type == EV_SIGNAL1) { rs.signals1++; return; }
+    if (rec.type == EV_SIGNAL2) { rs.signals2++; return; }
+
+    if (rec.pid < 0 || rec.pid >= rs.hdr.passenger_count) {
+        violation(rs, rec, "unknown rider");
+        return;
+    }
+    ReplayRider& r = rs.riders[rec.pid];
+    uint64_t cost = rs.hdr.kind_cost[r.kind];
+
+    switch (rec.type) {
+        case EV_ADMIT:
+            if (r.st != R_QUEUE) violation(rs, rec, "rider not in queue");
+            if (rs.phase != PHASE_LOADING) violation(rs, rec, "admission outside loading");
+            r.st = R_BRIDGE_IN;
+            take(rs, rec, cost & RES_BRIDGE_LANE, 1);
+            break;
+        case EV_BOARD:
+            if (r.st != R_BRIDGE_IN) violation(rs, rec, "rider not boarding from bridge");
+            if (rs.phase != PHASE_LOADING) violation(rs, rec, "boarding outside loading");
+            r.st = R_SHIP;
+            r.board_time_us = rec.time_us;
+            if (!r.away && rs.ship_location == r.home) {
+                r.away = true;
+                r.left_home_us = r.queued_us;
+            }
+            take(rs, rec, cost & RES_BRIDGE_LANE, -1);
+            take(rs, rec, cost & RES_SHIP_LANES, 1);
+            break;
+        case EV_RETURN:
+            if (r.st != R_BRIDGE_IN) violation(rs, rec, "rider not on bridge");
+            r.st = R_QUEUE;
+            take(rs, rec, cost & RES_BRIDGE_LANE, -1);
+            break;
+        case EV_DISEMBARK:
+            if (r.st != R_SHIP) violation(rs, rec, "rider not on ship");
+            if (rs.phase != PHASE_UNLOADING) violation(rs, rec, "disembark outside unloading");
+            r.st = R_BRIDGE_OUT;
+            take(rs, rec, cost & RES_SHIP_LANES, -1);
+            take(rs, rec, cost & RES_BRIDGE_LANE, 1);
+            break;
+        case EV_EXIT:
+            if (r.st != R_BRIDGE_OUT) violation(rs, rec, "rider not leaving ship");
+            r.st = R_EXITED;
+            r.exit_location = rs.ship_location;
+            take(rs, rec, cost & RES_BRIDGE_LANE, -1);
+            if (rs.ship_location != r.origin) {
+                r.deliveries++;
+                r.total_deliveries++;
+                rs.waits.push_back(r.board_time_us - r.queued_us);
+                rs.class_waits[r.ticket_class].push_back(r.board_time_us - r.queued_us);
+                if (r.deliveries > rs.hdr.rider_trips) violation(rs, rec, "rider delivered more legs than RIDER_TRIPS");
+                if (r.away && rs.ship_location == r.home) {
+                    rs.round_trips.push_back(rec.time_us - r.left_home_us);
+                    r.away = false;
+                }
+            }
+            break;
+        case EV_REJOIN:
+            // A rider with legs left queues again at the pier it just reached
+            if (r.st != R_EXITED) violation(rs, rec, "rejoin by a rider that has not exited");
+            if (r.deliveries >= rs.hdr.rider_trips) violation(rs, rec, "rejoin after the last leg");
+            r.st = R_QUEUE;
+            r.origin = r.exit_location;
+            r.queued_us = rec.time_us;
+            break;
+        default:
+            violation(rs, rec, "unknown event type");
+            break;
+    }
+}
+
+static uint64_t percentile(std::vector<uint64_t>& v, int p) {
+    if (v.empty()) return 0;
+    size_t idx = (v.size() - 1) * p / 100;
+    return v[idx];
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <simulation.jnl>" << std::endl;
+        return 1;
+    }
+
+    std::ifstream file(argv[1], std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: Cannot open journal: " << argv[1] << std::endl;
+        return 1;
+    }
+
+    ReplayState rs = {};
+    file.read((char*)&rs.hdr, sizeof(rs.hdr));
+    if (!file || rs.hdr.magic != JOURNAL_MAGIC || rs.hdr.version != JOURNAL_VERSION) {
+        std::cerr << "Error: Not a water tram journal: " << argv[1] << std::endl;
+        return 1;
+    }
+
+    std::vector<uint8_t> flags(rs.hdr.passenger_count);
+    file.read((char*)flags.data(), flags.size());
+    rs.riders.resize(rs.hdr.passenger_count);
+    for (int i = 0; i < rs.hdr.passenger_count; i++) {
+        rs.riders[i] = {};
+        rs.riders[i].kind = flags[i] & RIDER_FLAG_KIND_MASK;
+        rs.riders[i].ticket_class = (flags[i] & RIDER_FLAG_CLASS_MASK) >> RIDER_FLAG_CLASS_SHIFT;
+        rs.riders[i].origin = (flags[i] & RIDER_FLAG_WAWEL) ? WAWEL : TYNIEC;
+        rs.riders[i].st = R_QUEUE;
+        rs.riders[i].home = rs.riders[i].origin;
+    }
+    rs.phase = PHASE_LOADING;
+    rs.ship_location = TYNIEC;
+    rs.days = 1;
+
+    // A writer killed between reserving its slot and filling it leaves a zeroed record
+    std::vector<JournalRecord> records;
+    JournalRecord rec;
+    long torn = 0;
+    while (file.read((char*)&rec, sizeof(rec))) {
+        if (rec.type == 0) torn++;
+        else records.push_back(rec);
+    }
+    if (torn > 0) std::cout << "Skipped " << torn << " unfilled records" << std::endl;
+
+    for (const JournalRecord& r : records)
+        apply(rs, r);
+
+    int delivered = 0, stranded = 0;
+    std::vector<uint64_t>& waits = rs.waits;
+    for (const ReplayRider& r : rs.riders) {
+        delivered += r.total_deliveries;
+        if (r.st == R_BRIDGE_IN || r.st == R_SHIP || r.st == R_BRIDGE_OUT) stranded++;
+    }
+    std::sort(waits.begin(), waits.end());
+
+    uint64_t duration_us = records.empty() ? 0 : records.back().time_us;
+    if (stranded > 0) {
+        rs.violations++;
+        std::cout << "VIOLATION: " << stranded << " riders left on bridge or ship at end of journal" << std::endl;
+    }
+    if (std::count(rs.used, rs.used + RES_LANES, 0) != RES_LANES) {
+        rs.violations++;
+        std::cout << "VIOLATION: ship/bridge not empty at end of journal" << std::endl;
+    }
+
+    std::cout << "\n=== Replay ===" << std::endl;
+    std::cout << "Config:     N=" << rs.hdr.n << " M=" << rs.hdr.m << " K=" << rs.hdr.k
+              << " T1=" << rs.hdr.t1 << " T2=" << rs.hdr.t2 << " R=" << rs.hdr.r << std::endl;
+    std::cout << "Events:     " << records.size() << std::endl;
+    std::cout << "Duration:   " << duration_us / 1000 << " ms" << std::endl;
+    std::cout << "Days:       " << rs.days << std::endl;
+    std::cout << "Trips:      " << rs.trips << std::endl;
+    std::cout << "Trip loads:";
+    for (int load : rs.trip_loads) std::cout << " " << load;
+    std::cout << std::endl;
+    std::cout << "Signals:    signal1=" << rs.signals1 << " signal2=" << rs.signals2 << std::endl;
+    std::cout << "Delivered:  " << delivered << "/" << (long)rs.hdr.passenger_count * rs.days * rs.hdr.rider_trips << std::endl;
+    if (duration_us > 0)
+        std::cout << "Throughput: " << delivered * 60000000.0 / duration_us << " riders/min" << std::endl;
+    std::cout << "Wait (ms):  p50=" << percentile(waits, 50) / 1000
+              << " p90=" << percentile(waits, 90) / 1000
+              << " max=" << (waits.empty() ? 0 : waits.back() / 1000) << std::endl;
+    if (rs.class_waits[CLASS_STANDARD].size() < waits.size()) {
+        static const char* class_names[RIDER_CLASSES] = {"standard", "priority", "season"};
+        for (int c = 0; c < RIDER_CLASSES; c++) {
+            std::vector<uint64_t>& w = rs.class_waits[c];
+            if (w.empty()) continue;
+            std::sort(w.begin(), w.end());
+            std::cout << "  " << class_names[c] << ": n=" << w.size()
+                      << " p50=" << percentile(w, 50) / 1000 << " p90=" << percentile(w, 90) / 1000
+                      << " p99=" << percentile(w, 99) / 1000 << " max=" << w.back() / 1000 << std::endl;
+        }
+    }
+    if (!rs.round_trips.empty()) {
+        std::vector<uint64_t>& rt = rs.round_trips;
+        std::sort(rt.begin(), rt.end());
+        std::cout << "Round trip (ms): n=" << rt.size() << " p50=" << percentile(rt, 50) / 1000
+                  << " p90=" << percentile(rt, 90) / 1000 << " max=" << rt.back() / 1000 << std::endl;
+    }
+    std::cout << "Violations: " << rs.violations << std::endl;
+
+    return rs.violations > 0 ? 1 : 0;
+}
@@ -0,0 +1,127 @@
+#include "scan.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+static ScanImpl detect_impl() {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SCAN_AVX2;
+    return SCAN_SSE2;
+#else
+    return SCAN_SCALAR;
+#endif
+}
+
+static ScanImpl best_impl = detect_impl();
+static ScanImpl impl = best_impl;
+
+ScanImpl scan_best_impl() {
+    return best_impl;
+}
+
+// Never goes above what the CPU supports
+void set_scan_impl(ScanImpl want) {
+    impl = want < best_impl ? want : best_impl;
+}
+
+const char* scan_impl_name(ScanImpl which) {
+    switch (which) {
+        case SCAN_AVX2: return "avx2";
+        case SCAN_SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+static int next_scalar(const uint8_t* flags, int i, int n, uint8_t mask, uint8_t value) {
+    for (; i < n; i++) {
+        if ((flags[i] & mask) == value) return i;
+    }
+    return n;
+}
+
+static int count_scalar(const uint8_t* flags, int i, int n, uint8_t mask, uint8_t value) {
+    int count = 0;
+    for (; i < n; i++) count += (flags[i] & mask) == value;
+    return count;
+}
+
+#ifdef SCAN_X86
+static int next_sse2(const uint8_t* flags, int i, int n, uint8_t mask, uint8_t value) {
+    __m128i m = _mm_set1_epi8((char)mask);
+    __m128i v = _mm_set1_epi8((char)value);
+    for (; i + 16 <= n; i += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i*)(flags + i));
+        int hits = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(b, m), v));
+        if (hits) return i + __builtin_ctz(hits);
+    }
+    return next_scalar(flags, i, n, mask, value);
+}
+
+static int count_sse2(const uint8_t* flags, int n, uint8_t mask, uint8_t value) {
+    __m128i m = _mm_set1_epi8((char)mask);
+    __m128i v = _mm_set1_epi8((char)value);
+    long count = 0;
+    int i = 0;
+    while (i + 16 <= n) {
+        // Byte lanes count matches until they could overflow, then fold into count
+        __m128i acc = _mm_setzero_si128();
+        for (int k = 0; k < 255 && i + 16 <= n; k++, i += 16) {
+            __m128i b = _mm_loadu_si128((const __m128i*)(flags + i));
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(_mm_and_si128(b, m), v));
+        }
+        __m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+        count += _mm_cvtsi128_si64(sums) + _mm_extract_epi16(sums, 4);
+    }
+    return count + count_scalar(flags, i, n, mask, value);
+}
+
+__attribute__((target("avx2")))
+static int next_avx2(const uint8_t* flags, int i, int n, uint8_t mask, uint8_t value) {
+    __m256i m = _mm256_set1_epi8((char)mask);
+    __m256i v = _mm256_set1_epi8((char)value);
+    for (; i + 32 <= n; i += 32) {
+        __m256i b = _mm256_loadu_si256((const __m256i*)(flags + i));
+        unsigned hits = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(b, m), v));
+        if (hits) return i + __builtin_ctz(hits);
+    }
+    return next_scalar(flags, i, n, mask, value);
+}
+
+__attribute__((target("avx2")))
+static int count_avx2(const uint8_t* flags, int n, uint8_t mask, uint8_t value) {
+    __m256i m = _mm256_set1_epi8((char)mask);
+    __m256i v = _mm256_set1_epi8((char)value);
+    long count = 0;
+    int i = 0;
+    while (i + 32 <= n) {
+        __m256i acc = _mm256_setzero_si256();
+        for (int k = 0; k < 255 && i + 32 <= n; k++, i += 32) {
+            __m256i b = _mm256_loadu_si256((const __m256i*)(flags + i));
+            acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(_mm256_and_si256(b, m), v));
+        }
+        __m256i sums = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+        count += _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1) +
+                 _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3);
+    }
+    return count + count_scalar(flags, i, n, mask, value);
+}
+#endif
+
+int scan_next(const uint8_t* flags, int from, int n, uint8_t mask, uint8_t value) {
+#ifdef SCAN_X86
+    if (impl == SCAN_AVX2) return next_avx2(flags, from, n, mask, value);
+    if (impl == SCAN_SSE2) return next_sse2(flags, from, n, mask, value);
+#endif
+    return next_scalar(flags, from, n, mask, value);
+}
+
+int scan_count(const uint8_t* flags, int n, uint8_t mask, uint8_t value) {
+#ifdef SCAN_X86
+    if (impl == SCAN_AVX2) return count_avx2(flags, n, mask, value);
+    if (impl == SCAN_SSE2) return count_sse2(flags, n, mask, value);
+#endif
+    return count_scalar(flags, 0, n, mask, value);
+}
@@ -0,0 +1,23 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <cstdint>
+
+// Scans over the packed rider bytes (RIDER_* in common.h). A rider matches
+// when (flags & mask) == value. On x86-64 the widest supported vector unit
+// is picked at start-up; elsewhere only the scalar loops exist.
+enum ScanImpl {
+    SCAN_SCALAR = 0,
+    SCAN_SSE2 = 1,
+    SCAN_AVX2 = 2
+};
+
+ScanImpl scan_best_impl();
+void set_scan_impl(ScanImpl impl);
+const char* scan_impl_name(ScanImpl impl);
+
+// First index >= from that matches, or n
+int scan_next(const uint8_t* flags, int from, int n, uint8_t mask, uint8_t value);
+int scan_count(const uint8_t* flags, int n, uint8_t mask, uint8_t value);
+
+#endif
@@ -0,0 +1,90 @@
+#include "common.h"
+#include "scan.h"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+// Times the captain's and auditor's rider scans on synthetic worst cases:
+// every scan has to walk the whole population before it finds (or misses) a match.
+// "legacy" is the same scan over the int/bool arrays the packed bytes replaced.
+
+static volatile long sink;
+
+template <typename F>
+static double time_scan(int n, F scan) {
+    int reps = std::max(20, 200000000 / n);
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; r++) sink += scan();
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / reps;
+}
+
+struct Bench {
+    const char* name;
+    double legacy_ns;
+    double ns[3];
+};
+
+static void print_row(const Bench& b, ScanImpl best) {
+    printf("  %-18s legacy %9.0f ns", b.name, b.legacy_ns);
+    for (int i = SCAN_SCALAR; i <= best; i++)
+        printf("  %s %9.0f ns", scan_impl_name((ScanImpl)i), b.ns[i]);
+    printf("  (%.1fx vs legacy)\n", b.legacy_ns / b.ns[best]);
+}
+
+static void run(int n, ScanImpl best) {
+    std::vector<int> states(n, STATE_QUEUE), locations(n, TYNIEC);
+    std::vector<char> bikes(n, 1);
+    std::vector<uint8_t> flags(n, 0);
+    
+    // All riders queued at TYNIEC, none exited
+    for (int i = 0; i < n; i++) flags[i] = STATE_QUEUE | (bikes[i] ? KIND_BIKE << RIDER_KIND_SHIFT : 0);
+    uint8_t where = RIDER_STATE_MASK | RIDER_WAWEL;
+    
+    Bench waiting = {"any at WAWEL", 0, {}};
+    Bench exited = {"count exited", 0, {}};
+    
+    waiting.legacy_ns = time_scan(n, [&] {
+        for (int i = 0; i < n; i++) if (states[i] == STATE_QUEUE && locations[i] == WAWEL) return i;
+        return n;
+    });
+    exited.legacy_ns = time_scan(n, [&] {
+        int c = 0;
+        for (int i = 0; i < n; i++) c += states[i] == STATE_EXITED;
+        return c;
+    });
+    
+    for (int i = SCAN_SCALAR; i <= best; i++) {
+        set_scan_impl((ScanImpl)i);
+        waiting.ns[i] = time_scan(n, [&] { return scan_next(flags.data(), 0, n, where, STATE_QUEUE | RIDER_WAWEL); });
+        exited.ns[i] = time_scan(n, [&] { return scan_count(flags.data(), n, RIDER_STATE_MASK, STATE_EXITED); });
+        if (scan_next(flags.data(), 0, n, where, STATE_QUEUE | RIDER_WAWEL) != n ||
+            scan_count(flags.data(), n, RIDER_STATE_MASK, STATE_EXITED) != 0) {
+            std::cerr << "Error: " << scan_impl_name((ScanImpl)i) << " scan gave a wrong answer" << std::endl;
+            exit(1);
+        }
+    }
+    
+    printf("%d riders:\n", n);
+    print_row(waiting, best);
+    print_row(exited, best);
+}
+
+int main(int argc, char* argv[]) {
+    ScanImpl best = scan_best_impl();
+    printf("=== scanbench (best: %s) ===\n", scan_impl_name(best));
+    
+    std::vector<int> sizes;
+    for (int i = 1; i < argc; i++) sizes.push_back(atoi(argv[i]));
+    if (sizes.empty()) sizes = {10000, 100000};
+    
+    for (int n : sizes) {
+        if (n < 1 || n > MAX_PASSENGERS) {
+            std::cerr << "Error: Rider count must be 1.." << MAX_PASSENGERS << std::endl;
+            return 1;
+        }
+        run(n, best);
+    }
+    return 0;
+}
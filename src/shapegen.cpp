@@ -0,0 +1,42 @@
+#include "common.h"
+#include "config.h"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+
+// Writes fixed_shape.h for a TRAM_FIXED_CONFIG build: shared arrays sized to
+// the config and its capacities and rider costs as compile-time constants.
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <config.env> <fixed_shape.h>" << std::endl;
+        return 1;
+    }
+    
+    Config cfg;
+    if (!load_config(argv[1], cfg) || !validate_config(cfg)) return 1;
+    
+    unsigned kinds = rider_kinds(cfg);
+    
+    std::ofstream out(argv[2]);
+    if (!out.is_open()) {
+        std::cerr << "Error: Cannot write " << argv[2] << std::endl;
+        return 1;
+    }
+    out << "// Generated by shapegen from " << argv[1] << "; do not edit\n"
+        << "#ifndef FIXED_SHAPE_H\n#define FIXED_SHAPE_H\n\n"
+        << "#define TRAM_FIXED_RIDERS " << std::max(total_riders(cfg), cfg.N) << "\n"
+        << "#define TRAM_FIXED_BRIDGE " << cfg.K << "\n"
+        << std::hex << std::showbase
+        << "#define TRAM_FIXED_CAPACITY " << res_vec(cfg.K, cfg.N, cfg.M, cfg.spaces) << "ULL\n"
+        << "#define TRAM_FIXED_KINDS " << kinds << "\n"
+        << "#define TRAM_FIXED_COSTS";
+    for (int kind = 0; kind < RIDER_KINDS; kind++)
+        out << (kind ? ", " : " ") << kind_cost(cfg, kind) << "ULL";
+    out << "\n\n#endif\n";
+    if (!out) {
+        std::cerr << "Error: Cannot write " << argv[2] << std::endl;
+        return 1;
+    }
+    return 0;
+}
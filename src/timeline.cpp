@@ -0,0 +1,115 @@
+#include "timeline.h"
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <random>
+#include <algorithm>
+
+static bool parse_time_us(const std::string& s, long& us) {
+    size_t used = 0;
+    double v;
+    try {
+        v = std::stod(s, &used);
+    } catch (...) {
+        return false;
+    }
+    std::string unit = s.substr(used);
+    if (unit == "ms") us = (long)(v * 1000);
+    else if (unit == "s") us = (long)(v * 1000000);
+    else return false;
+    return us >= 0;
+}
+
+static bool parse_signal(const std::string& s, char& signal) {
+    if (s == "signal1") signal = '1';
+    else if (s == "signal2") signal = '2';
+    else return false;
+    return true;
+}
+
+static bool parse_count(const std::string& s, int& n) {
+    try {
+        n = std::stoi(s);
+    } catch (...) {
+        return false;
+    }
+    return n > 0;
+}
+
+// "5s..20s" -> window in us
+static bool parse_window(const std::string& s, long& from, long& to) {
+    size_t dots = s.find("..");
+    if (dots == std::string::npos) return false;
+    return parse_time_us(s.substr(0, dots), from) && parse_time_us(s.substr(dots + 2), to) && from <= to;
+}
+
+struct Storm {
+    long from_us, to_us, every_us, jitter_us;
+    char signal;
+};
+
+bool load_timeline(const char* filename, Timeline& timeline) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Error: Cannot open timeline: " << filename << std::endl;
+        return false;
+    }
+    
+    timeline = {};
+    std::vector<Storm> storms;
+    uint64_t seed = 1;
+    std::string line;
+    int line_no = 0;
+    
+    while (std::getline(file, line)) {
+        line_no++;
+        size_t comment_pos = line.find('#');
+        if (comment_pos != std::string::npos) line = line.substr(0, comment_pos);
+        
+        std::istringstream in(line);
+        std::vector<std::string> w;
+        for (std::string tok; in >> tok;) w.push_back(tok);
+        if (w.empty()) continue;
+        
+        bool ok = false;
+        TimelineEvent ev = {-1, 0, 0, 0};
+        if (w[0] == "seed" && w.size() == 2) {
+            try {
+                seed = std::stoull(w[1]);
+                ok = true;
+            } catch (...) {}
+        } else if (w[0] == "at" && w.size() == 3) {
+            ok = parse_time_us(w[1], ev.at_us) && parse_signal(w[2], ev.signal);
+            if (ok) timeline.timed.push_back(ev);
+        } else if (w[0] == "at" && w.size() == 4 && w[1] == "trip") {
+            ok = parse_count(w[2], ev.trip) && parse_signal(w[3], ev.signal);
+            if (ok) timeline.trips.push_back(ev);
+        } else if (w[0] == "at" && w.size() == 6 && w[1] == "day" && w[3] == "trip") {
+            ok = parse_count(w[2], ev.day) && parse_count(w[4], ev.trip) && parse_signal(w[5], ev.signal);
+            if (ok) timeline.trips.push_back(ev);
+        } else if (w[0] == "storm" && (w.size() == 5 || w.size() == 7) && w[2] == "every") {
+            Storm st = {0, 0, 0, 0, 0};
+            ok = parse_window(w[1], st.from_us, st.to_us) && parse_time_us(w[3], st.every_us) && st.every_us > 0;
+            if (w.size() == 7) ok = ok && w[4] == "jitter" && parse_time_us(w[5], st.jitter_us);
+            ok = ok && parse_signal(w.back(), st.signal);
+            if (ok) storms.push_back(st);
+        }
+        if (!ok) {
+            std::cerr << "Error: " << filename << ":" << line_no << ": cannot parse \"" << line << "\"" << std::endl;
+            return false;
+        }
+    }
+    
+    // Every storm tick lands uniformly within +-jitter of its slot, clipped to the window
+    std::mt19937_64 rng(seed);
+    for (const Storm& st : storms) {
+        std::uniform_int_distribution<long> jitter(-st.jitter_us, st.jitter_us);
+        for (long t = st.from_us; t <= st.to_us; t += st.every_us) {
+            long at = std::min(st.to_us, std::max(st.from_us, t + jitter(rng)));
+            timeline.timed.push_back({at, 0, 0, st.signal});
+        }
+    }
+    std::stable_sort(timeline.timed.begin(), timeline.timed.end(),
+                     [](const TimelineEvent& a, const TimelineEvent& b) { return a.at_us < b.at_us; });
+    return true;
+}
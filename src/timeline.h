@@ -0,0 +1,29 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <vector>
+
+// Scripted dispatcher signals, one statement per line ('#' starts a comment):
+//   at 12.5s signal1                      - at a time since simulation start
+//   at trip 7 signal2                     - when loading of trip 7 starts, every day
+//   at day 2 trip 3 signal1               - same, on day 2 only
+//   storm 5s..20s every 500ms jitter 200ms signal1
+//                                         - randomized signals across a time window
+//   seed 42                               - seeds the storms (default 1)
+// Times take an "ms" or "s" suffix. Storms are expanded at load time, so the
+// same file always gives the same signal times.
+struct TimelineEvent {
+    long at_us;
+    int day;
+    int trip;
+    char signal;
+};
+
+struct Timeline {
+    std::vector<TimelineEvent> timed;
+    std::vector<TimelineEvent> trips;
+};
+
+bool load_timeline(const char* filename, Timeline& timeline);
+
+#endif
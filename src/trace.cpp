@@ -0,0 +1,218 @@
+#include "trace.h"
+#include "journal.h"
+#include "logger.h"
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+#define TRACE_PID_CAPTAIN 1
+#define TRACE_PID_RIDERS 2
+#define TRACE_PID_OCCUPANCY 3
+
+// Tracks under the captain
+#define TRACE_TID_PHASE 0
+#define TRACE_TID_SIGNALS 1
+
+static TraceHeader* trace_buf = nullptr;
+static bool trace_failed = false;
+
+static TraceRecord* trace_records(TraceHeader* hdr) {
+    return reinterpret_cast<TraceRecord*>(hdr + 1);
+}
+
+// Records are only backed once touched, so the bound can be generous; beyond it write_trace reports drops
+#define TRACE_MAX_RECORDS (1L << 25)
+
+// A rider makes at most six moves a leg outside bridge clears. Each trip adds its phase changes and
+// one bridge clear, which sends at most K riders back (ADMIT then RETURN); signals share a fixed allowance
+void init_trace(SharedState* state) {
+    long per_trip = 2L * state->bridge_capacity + 6;
+    long capacity = ((long)state->passenger_count * 6 * state->rider_trips
+                     + per_trip * (state->max_trips + 1) + 4096) * state->days;
+    if (capacity > TRACE_MAX_RECORDS) {
+        log_msg<LOG_WARN>(state, "Trace: bound of %ld events capped at %ld, later events may be dropped",
+                          capacity, TRACE_MAX_RECORDS);
+        capacity = TRACE_MAX_RECORDS;
+    }
+    size_t size = sizeof(TraceHeader) + capacity * sizeof(TraceRecord);
+    int shm_id = shmget(TRACE_KEY, size, IPC_CREAT | IPC_EXCL | 0600);
+    if (shm_id == -1) {
+        perror("shmget trace");
+        exit(1);
+    }
+    void* ptr = shmat(shm_id, nullptr, 0);
+    if (ptr == (void*)-1) {
+        perror("shmat trace");
+        exit(1);
+    }
+    trace_buf = static_cast<TraceHeader*>(ptr);
+    trace_buf->capacity = capacity;
+    trace_buf->count = 0;
+    state->trace_enabled = true;
+}
+
+static bool attach_trace() {
+    if (trace_buf) return true;
+    if (trace_failed) return false;
+    
+    int shm_id = shmget(TRACE_KEY, 0, 0600);
+    void* ptr = shm_id == -1 ? (void*)-1 : shmat(shm_id, nullptr, 0);
+    if (ptr == (void*)-1) {
+        perror("attach trace");
+        trace_failed = true;
+        return false;
+    }
+    trace_buf = static_cast<TraceHeader*>(ptr);
+    return true;
+}
+
+// Called with the locks of the transition held, so the counters are consistent
+void trace_record(SharedState* state, uint8_t type, int pid, int aux) {
+    if (!attach_trace()) return;
+    
+    long idx = __atomic_fetch_add(&trace_buf->count, 1, __ATOMIC_RELAXED);
+    if (idx >= trace_buf->capacity) return;
+    
+    TraceRecord& rec = trace_records(trace_buf)[idx];
+    rec.time_us = (uint64_t)get_elapsed_us(state);
+    rec.pid = pid;
+    rec.type = type;
+    rec.aux = (uint8_t)aux;
+    rec.trip = (uint16_t)state->trip_num;
+    rec.bridge_count = state->bridge_count;
+    rec.ship_people = state->ship_people;
+}
+
+static const char* phase_name(int phase) {
+    switch (phase) {
+        case PHASE_LOADING: return "LOADING";
+        case PHASE_BRIDGE_CLEAR: return "BRIDGE_CLEAR";
+        case PHASE_SAILING: return "SAILING";
+        case PHASE_UNLOADING: return "UNLOADING";
+        case PHASE_END: return "END";
+        default: return "INIT";
+    }
+}
+
+static void write_span(FILE* f, const char* name, int pid, int tid, uint64_t from, uint64_t to, int trip) {
+    fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%lu,\"dur\":%lu,\"args\":{\"trip\":%d}}",
+            name, pid, tid, (unsigned long)from, (unsigned long)(to - from), trip);
+}
+
+static void write_counter(FILE* f, const char* name, uint64_t ts, int value) {
+    fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":%d,\"ts\":%lu,\"args\":{\"value\":%d}}",
+            name, TRACE_PID_OCCUPANCY, (unsigned long)ts, value);
+}
+
+struct RiderSpan {
+    const char* name;
+    uint64_t since;
+    int trip;
+};
+
+void write_trace(SharedState* state) {
+    if (!attach_trace()) return;
+    
+    long count = trace_buf->count;
+    if (count > trace_buf->capacity) {
+        log_msg<LOG_WARN>(state, "Trace buffer full, dropped %ld events", count - trace_buf->capacity);
+        count = trace_buf->capacity;
+    }
+    std::vector<TraceRecord> recs(trace_records(trace_buf), trace_records(trace_buf) + count);
+    std::stable_sort(recs.begin(), recs.end(), [](const TraceRecord& a, const TraceRecord& b) {
+        return a.time_us < b.time_us;
+    });
+    
+    char path[300];
+    snprintf(path, sizeof(path), "%.*s.trace.json",
+             (int)(strlen(state->log_file) - 4), state->log_file);
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        perror("open trace");
+        return;
+    }
+    
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"Captain\"}}", TRACE_PID_CAPTAIN);
+    fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"phase\"}}",
+            TRACE_PID_CAPTAIN, TRACE_TID_PHASE);
+    fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"signals\"}}",
+            TRACE_PID_CAPTAIN, TRACE_TID_SIGNALS);
+    // Counters are per process in the trace-event format, so they get a process of their own
+    fprintf(f, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"Occupancy\"}}", TRACE_PID_OCCUPANCY);
+    fprintf(f, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"Riders\"}}", TRACE_PID_RIDERS);
+    for (int i = 0; i < state->passenger_count; i++) {
+        fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"P%d%s %s\"}}",
+                TRACE_PID_RIDERS, i, i, kind_tag(rider_kind(state, i)),
+                location_name(rider_location(state, i)));
+    }
+    
+    std::vector<RiderSpan> riders(state->passenger_count, RiderSpan{"queue", 0, 0});
+    int phase = PHASE_INIT;
+    uint64_t phase_since = 0;
+    int phase_trip = 0;
+    uint64_t end = recs.empty() ? 0 : recs.back().time_us;
+    
+    for (const TraceRecord& r : recs) {
+        if (r.type == EV_PHASE) {
+            if (phase != PHASE_INIT)
+                write_span(f, phase_name(phase), TRACE_PID_CAPTAIN, TRACE_TID_PHASE, phase_since, r.time_us, phase_trip);
+            phase = r.aux;
+            phase_since = r.time_us;
+            phase_trip = r.trip;
+            continue;
+        }
+        if (r.type == EV_SIGNAL1 || r.type == EV_SIGNAL2) {
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%d,\"ts\":%lu}",
+                    journal_event_name(r.type), TRACE_PID_CAPTAIN, TRACE_TID_SIGNALS, (unsigned long)r.time_us);
+            continue;
+        }
+        if (r.type == EV_DAY) {
+            fprintf(f, ",\n{\"name\":\"DAY %d\",\"ph\":\"i\",\"s\":\"g\",\"pid\":%d,\"tid\":%d,\"ts\":%lu}",
+                    r.aux, TRACE_PID_CAPTAIN, TRACE_TID_PHASE, (unsigned long)r.time_us);
+            for (RiderSpan& s : riders) {
+                if (s.name) continue;
+                s.name = "queue";
+                s.since = r.time_us;
+                s.trip = 0;
+            }
+            continue;
+        }
+        if (r.pid < 0 || r.pid >= state->passenger_count) continue;
+        
+        RiderSpan& s = riders[r.pid];
+        if (s.name) write_span(f, s.name, TRACE_PID_RIDERS, r.pid, s.since, r.time_us, s.trip);
+        switch (r.type) {
+            case EV_ADMIT: s.name = "bridge"; break;
+            case EV_BOARD: s.name = "ship"; break;
+            case EV_RETURN: s.name = "queue"; break;
+            case EV_DISEMBARK: s.name = "bridge"; break;
+            case EV_REJOIN: s.name = "queue"; break;
+            default: s.name = nullptr; break;
+        }
+        s.since = r.time_us;
+        s.trip = r.trip;
+        write_counter(f, "bridge_count", r.time_us, r.bridge_count);
+        write_counter(f, "ship_people", r.time_us, r.ship_people);
+    }
+    
+    if (phase != PHASE_INIT && phase != PHASE_END)
+        write_span(f, phase_name(phase), TRACE_PID_CAPTAIN, TRACE_TID_PHASE, phase_since, end, phase_trip);
+    for (int i = 0; i < state->passenger_count; i++) {
+        if (riders[i].name)
+            write_span(f, riders[i].name, TRACE_PID_RIDERS, i, riders[i].since, end, riders[i].trip);
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    
+    log_msg<LOG_INFO>(state, "Trace: %s (%ld events)", path, count);
+}
+
+void remove_trace() {
+    if (trace_buf) {
+        shmdt(trace_buf);
+        trace_buf = nullptr;
+    }
+    int shm_id = shmget(TRACE_KEY, 0, 0600);
+    if (shm_id != -1) shmctl(shm_id, IPC_RMID, nullptr);
+}
@@ -0,0 +1,28 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "common.h"
+#include <cstdint>
+
+// Shared segment at TRACE_KEY: TraceHeader followed by `capacity` TraceRecords
+struct TraceHeader {
+    long capacity;
+    long count;
+};
+
+struct TraceRecord {
+    uint64_t time_us;
+    int32_t pid;
+    uint8_t type;
+    uint8_t aux;
+    uint16_t trip;
+    int32_t bridge_count;
+    int32_t ship_people;
+};
+
+void init_trace(SharedState* state);
+void trace_record(SharedState* state, uint8_t type, int pid, int aux);
+void write_trace(SharedState* state);
+void remove_trace();
+
+#endif
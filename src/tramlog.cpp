@@ -0,0 +1,390 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Offline analyzer for simulation_*.log (or all segments listed in a .idx):
+// parses chunks of the mapped files in parallel and rebuilds per-rider
+// timelines from the passenger DEBUG lines.
+
+enum LogEventType : uint8_t {
+    LE_ADMIT,
+    LE_BOARD,
+    LE_RETURN,
+    LE_DISEMBARK,
+    LE_EXIT,
+    LE_DAY,
+    LE_TRIP,
+    LE_LOADED,
+    LE_SAIL,
+    LE_ARRIVE,
+    LE_REJOIN
+};
+
+struct LogEvent {
+    uint32_t time_ms;
+    int32_t id;
+    uint8_t type;
+};
+
+struct ChunkResult {
+    std::vector<LogEvent> riders;
+    std::vector<LogEvent> captain;
+    long lines;
+    long gaps;
+    int n, m, k, t1, t2, r;
+    bool have_config;
+};
+
+static inline bool starts_with(const char* p, const char* end, const char* lit, size_t len) {
+    return (size_t)(end - p) >= len && memcmp(p, lit, len) == 0;
+}
+
+static inline int parse_int(const char*& p, const char* end) {
+    int v = 0;
+    while (p < end && *p >= '0' && *p <= '9') v = v * 10 + (*p++ - '0');
+    return v;
+}
+
+static inline int digits(const char* p, int n) {
+    int v = 0;
+    for (int i = 0; i < n; i++) v = v * 10 + (p[i] - '0');
+    return v;
+}
+
+static void parse_config(const char* p, const char* end, ChunkResult& out) {
+    int* fields[] = {&out.n, &out.m, &out.k, &out.t1, &out.t2, &out.r};
+    for (int* f : fields) {
+        while (p < end && *p != '=') p++;
+        if (p == end) return;
+        p++;
+        *f = parse_int(p, end);
+    }
+    out.have_config = true;
+}
+
+// Lines look like "[HH:MM:SS.mmm] [SOURCE] message"
+static void parse_line(const char* p, const char* end, ChunkResult& out) {
+    if (end - p < 18 || p[0] != '[' || p[13] != ']' || p[15] != '[') return;
+    uint32_t t = digits(p + 1, 2) * 3600000u + digits(p + 4, 2) * 60000u +
+                 digits(p + 7, 2) * 1000u + digits(p + 10, 3);
+    const char* s = p + 16;
+    
+    if (s[0] == 'P' && s[1] >= '0' && s[1] <= '9') {
+        s++;
+        int id = parse_int(s, end);
+        if (s < end && *s >= 'A' && *s <= 'Z') s++;
+        s += 2;
+        if (s >= end) return;
+        uint8_t type;
+        if (starts_with(s, end, "Entered bridge", 14)) type = LE_ADMIT;
+        else if (starts_with(s, end, "Entered ship", 12)) type = LE_BOARD;
+        else if (starts_with(s, end, "Disembarked", 11)) type = LE_DISEMBARK;
+        else if (starts_with(s, end, "Left bridge (", 13)) type = LE_RETURN;
+        else if (starts_with(s, end, "Left bridge", 11)) type = LE_EXIT;
+        else if (starts_with(s, end, "Rejoined queue", 14)) type = LE_REJOIN;
+        else return;
+        out.riders.push_back({t, id, type});
+        return;
+    }
+    
+    if (starts_with(s, end, "CAPTAIN] ", 9)) {
+        s += 9;
+        if (starts_with(s, end, "=== DAY ", 8)) {
+            s += 8;
+            out.captain.push_back({t, parse_int(s, end), LE_DAY});
+        } else if (starts_with(s, end, "=== Trip ", 9)) {
+            s += 9;
+            out.captain.push_back({t, parse_int(s, end), LE_TRIP});
+        } else if (starts_with(s, end, "Loading complete: ", 18)) {
+            s += 18;
+            out.captain.push_back({t, parse_int(s, end), LE_LOADED});
+        } else if (starts_with(s, end, "=== SAILING", 11)) {
+            out.captain.push_back({t, 0, LE_SAIL});
+        } else if (starts_with(s, end, "Arrived at", 10)) {
+            out.captain.push_back({t, 0, LE_ARRIVE});
+        }
+        return;
+    }
+    
+    if (starts_with(s, end, "MAIN] Config: ", 14)) parse_config(s + 14, end, out);
+}
+
+static void parse_chunk(const char* begin, const char* end, ChunkResult& out) {
+    const char* p = begin;
+    while (p < end) {
+        // Zeros are bytes a dying writer reserved but never filled; the next line starts after them
+        if (*p == '\0') {
+            while (p < end && *p == '\0') p++;
+            out.gaps++;
+            continue;
+        }
+        const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+        const char* line_end = nl ? nl : end;
+        parse_line(p, line_end, out);
+        out.lines++;
+        p = line_end + 1;
+    }
+}
+
+static uint32_t percentile(const std::vector<uint32_t>& v, int p) {
+    if (v.empty()) return 0;
+    return v[(v.size() - 1) * p / 100];
+}
+
+static void print_distribution(const char* name, std::vector<uint32_t>& v) {
+    std::sort(v.begin(), v.end());
+    printf("%-12s n=%-8zu p50=%-7u p90=%-7u p99=%-7u max=%u\n", name, v.size(),
+           percentile(v, 50), percentile(v, 90), percentile(v, 99), v.empty() ? 0 : v.back());
+}
+
+struct MappedLog {
+    const char* data;
+    size_t size;
+};
+
+struct Chunk {
+    const char* begin;
+    const char* end;
+};
+
+static bool map_file(const std::string& path, MappedLog& out) {
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        std::cerr << "Error: Cannot open log: " << path << std::endl;
+        return false;
+    }
+    out.size = st.st_size;
+    out.data = nullptr;
+    if (out.size > 0) {
+        void* ptr = mmap(nullptr, out.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED) {
+            perror("mmap");
+            close(fd);
+            return false;
+        }
+        out.data = static_cast<const char*>(ptr);
+        madvise(ptr, out.size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    return true;
+}
+
+// A .idx sidecar lists the segments of one run in order, then where each (day, trip) starts;
+// anything else is a single log
+static bool log_files(const std::string& path, std::vector<std::string>& files, int& index_trips, int& index_days) {
+    if (path.size() < 4 || path.compare(path.size() - 4, 4, ".idx") != 0) {
+        files.push_back(path);
+        return true;
+    }
+    std::ifstream idx(path);
+    if (!idx.is_open()) {
+        std::cerr << "Error: Cannot open index: " << path << std::endl;
+        return false;
+    }
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+    std::string line;
+    while (std::getline(idx, line)) {
+        std::istringstream in(line);
+        std::string kind, name;
+        int n, trip;
+        if (!(in >> kind >> n)) continue;
+        if (kind == "segment" && in >> name) files.push_back(dir + name);
+        else if (kind == "trip" && in >> trip) {
+            index_trips++;
+            index_days = std::max(index_days, n);
+        }
+    }
+    return !files.empty();
+}
+
+// Splits [data, data+size) into `parts` pieces whose boundaries fall on line starts
+static void split_chunks(const MappedLog& log, unsigned parts, std::vector<Chunk>& chunks) {
+    const char* end = log.data + log.size;
+    const char* prev = log.data;
+    for (unsigned i = 1; i <= parts && prev < end; i++) {
+        const char* p = i == parts ? end : log.data + log.size * i / parts;
+        if (p < prev) p = prev;
+        if (p < end) {
+            const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+            p = nl ? nl + 1 : end;
+        }
+        chunks.push_back({prev, p});
+        prev = p;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "Usage: " << argv[0] << " <simulation.log|simulation.idx> [threads]" << std::endl;
+        return 1;
+    }
+    
+    std::vector<std::string> files;
+    int index_trips = 0, index_days = 0;
+    if (!log_files(argv[1], files, index_trips, index_days)) return 1;
+    std::vector<MappedLog> logs(files.size());
+    size_t size = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!map_file(files[i], logs[i])) return 1;
+        size += logs[i].size;
+    }
+    if (size == 0) {
+        std::cerr << "Error: Empty log: " << argv[1] << std::endl;
+        return 1;
+    }
+    
+    unsigned threads = argc == 3 ? atoi(argv[2]) : std::thread::hardware_concurrency();
+    threads = std::max(1u, threads);
+    auto t0 = std::chrono::steady_clock::now();
+    
+    std::vector<Chunk> tasks;
+    for (const MappedLog& log : logs)
+        if (log.size > 0) split_chunks(log, threads, tasks);
+    
+    std::vector<ChunkResult> chunks(tasks.size());
+    std::atomic<size_t> next_task(0);
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next_task.fetch_add(1)) < tasks.size())
+            parse_chunk(tasks[i].begin, tasks[i].end, chunks[i]);
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; t++) pool.emplace_back(worker);
+    for (std::thread& t : pool) t.join();
+    
+    double parse_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    
+    // Merge: captain events in file order, rider events bucketed by rider id
+    long lines = 0, gaps = 0;
+    int max_id = -1;
+    ChunkResult cfg = {};
+    std::vector<LogEvent> captain;
+    for (ChunkResult& c : chunks) {
+        lines += c.lines;
+        gaps += c.gaps;
+        if (c.have_config && !cfg.have_config) cfg = c;
+        captain.insert(captain.end(), c.captain.begin(), c.captain.end());
+        for (const LogEvent& e : c.riders) max_id = std::max(max_id, e.id);
+    }
+    std::stable_sort(captain.begin(), captain.end(),
+                     [](const LogEvent& a, const LogEvent& b) { return a.time_ms < b.time_ms; });
+    
+    std::vector<size_t> start(max_id + 2, 0);
+    for (ChunkResult& c : chunks)
+        for (const LogEvent& e : c.riders) start[e.id + 1]++;
+    for (int i = 0; i <= max_id; i++) start[i + 1] += start[i];
+    std::vector<LogEvent> by_rider(start[max_id + 1]);
+    std::vector<size_t> fill(start.begin(), start.end() - 1);
+    for (ChunkResult& c : chunks)
+        for (const LogEvent& e : c.riders) by_rider[fill[e.id]++] = e;
+    
+    std::vector<uint32_t> sail_starts, day_starts(1, 0);
+    std::vector<int> loads;
+    uint32_t duration = 0, sailing_ms = 0, sail_since = 0;
+    int trips = 0, days = 1;
+    for (const LogEvent& e : captain) {
+        if (e.type == LE_DAY) {
+            if (e.id > 1) day_starts.push_back(e.time_ms);
+            days = std::max(days, e.id);
+        }
+        else if (e.type == LE_TRIP) trips++;
+        else if (e.type == LE_LOADED) loads.push_back(e.id);
+        else if (e.type == LE_SAIL) { sail_starts.push_back(e.time_ms); sail_since = e.time_ms; }
+        else if (e.type == LE_ARRIVE) sailing_ms += e.time_ms - sail_since;
+    }
+    if (!captain.empty()) duration = captain.back().time_ms;
+    for (const LogEvent& e : by_rider) duration = std::max(duration, e.time_ms);
+    
+    // A rider is delivered when a sailing started between boarding and disembarking;
+    // the wait of a delivered ride counts from the start of that day or the rider's last rejoin
+    std::vector<uint32_t> waits, bridge_dwell, rides;
+    int riders_seen = 0, boarded = 0, delivered = 0, returns = 0;
+    for (int id = 0; id <= max_id; id++) {
+        LogEvent* b = by_rider.data() + start[id];
+        LogEvent* e = by_rider.data() + start[id + 1];
+        if (b == e) continue;
+        riders_seen++;
+        std::stable_sort(b, e, [](const LogEvent& x, const LogEvent& y) { return x.time_ms < y.time_ms; });
+    
+        uint32_t admit = 0, board = 0, rejoined = 0;
+        bool rider_boarded = false;
+        for (LogEvent* ev = b; ev != e; ev++) {
+            switch (ev->type) {
+                case LE_ADMIT: admit = ev->time_ms; break;
+                case LE_REJOIN: rejoined = ev->time_ms; break;
+                case LE_BOARD:
+                    if (!rider_boarded) boarded++;
+                    rider_boarded = true;
+                    board = ev->time_ms;
+                    bridge_dwell.push_back(ev->time_ms - admit);
+                    break;
+                case LE_RETURN:
+                    returns++;
+                    bridge_dwell.push_back(ev->time_ms - admit);
+                    break;
+                case LE_DISEMBARK: {
+                    rides.push_back(ev->time_ms - board);
+                    auto it = std::lower_bound(sail_starts.begin(), sail_starts.end(), board);
+                    if (it != sail_starts.end() && *it <= ev->time_ms) {
+                        delivered++;
+                        uint32_t day_start = *(std::upper_bound(day_starts.begin(), day_starts.end(), board) - 1);
+                        waits.push_back(board - std::max(day_start, rejoined));
+                    }
+                    break;
+                }
+                default: break;
+            }
+        }
+    }
+    
+    printf("=== tramlog ===\n");
+    printf("File:        %s (%zu segment%s, %.1f MB, %ld lines)\n", argv[1], files.size(),
+           files.size() == 1 ? "" : "s", size / 1e6, lines);
+    if (gaps > 0) printf("Unfilled:    %ld zero-filled gaps skipped\n", gaps);
+    printf("Parse:       %.3f s on %u threads (%.2f GB/s)\n", parse_s, threads, size / 1e9 / parse_s);
+    if (cfg.have_config)
+        printf("Config:      N=%d M=%d K=%d T1=%d T2=%d R=%d\n", cfg.n, cfg.m, cfg.k, cfg.t1, cfg.t2, cfg.r);
+    printf("Duration:    %u ms\n", duration);
+    printf("Days:        %d\n", days);
+    printf("Trips:       %d\n", trips);
+    if (index_trips > 0)
+        printf("Index:       %d trip marks over %d day%s\n", index_trips, index_days, index_days == 1 ? "" : "s");
+    printf("Trip loads:");
+    long load_sum = 0;
+    for (int l : loads) {
+        printf(" %d", l);
+        load_sum += l;
+    }
+    printf("\n");
+    if (!loads.empty() && cfg.have_config && cfg.n > 0)
+        printf("Utilization: %.1f%% of N per trip, sailing %.1f%% of the day\n",
+               100.0 * load_sum / loads.size() / cfg.n, duration ? 100.0 * sailing_ms / duration : 0.0);
+    printf("Riders:      %d seen, %d boarded, %d delivered, %d returned to queue\n",
+           riders_seen, boarded, delivered, returns);
+    if (duration > 0)
+        printf("Throughput:  %.1f riders/min\n", delivered * 60000.0 / duration);
+    printf("Times (ms):\n");
+    print_distribution("  wait", waits);
+    print_distribution("  bridge", bridge_dwell);
+    print_distribution("  ride", rides);
+    if (riders_seen == 0)
+        printf("No passenger lines found (needs LOG_LEVEL=3 and TRAM_LOG_LEVEL=3)\n");
+    
+    for (const MappedLog& log : logs)
+        if (log.data) munmap((void*)log.data, log.size);
+    return 0;
+}
@@ -0,0 +1,79 @@
+#!/bin/bash
+# Runs one scenario with the journal and the auditor on; fails on a non-zero exit,
+# a VIOLATION line in the log or the replay, or a scripted signal that never arrived.
+# usage: run_scenario.sh <build dir> <name> <config.env> [timeline] [KEY=VALUE ...]
+# TRAM_EXPECT_LOG=<pattern> also requires a matching log line,
+# TRAM_EXPECT_ALL_DELIVERED=1 requires every rider to reach the other pier.
+set -u
+
+bin=$(realpath "$1")
+name=$2
+env=$(realpath "$3")
+shift 3
+timeline=""
+if [ $# -gt 0 ] && [[ $1 != *=* ]]; then
+    timeline=$(realpath "$1")
+    shift
+fi
+
+# main starts its children as ./captain etc., so each scenario gets its own directory of links
+dir=$bin/scenario_$name
+rm -rf "$dir"
+mkdir -p "$dir"
+for b in main captain dispatcher passenger auditor replay; do
+    ln -s "$bin/$b" "$dir/$b"
+done
+{
+    cat "$env"
+    echo
+    echo "JOURNAL=1"
+    echo "AUDIT=1"
+    echo "LOG_STDOUT=0"
+    for kv in "$@"; do echo "$kv"; done
+} > "$dir/scenario.env"
+cd "$dir" || exit 1
+
+fail() {
+    echo "FAIL [$name]: $1"
+    exit 1
+}
+
+timeout 600 ./main scenario.env $timeline < /dev/null > main.out 2>&1
+rc=$?
+[ $rc -eq 0 ] || { tail -20 main.out; fail "main exited with $rc"; }
+
+log=$(ls simulation_*.log 2> /dev/null | head -1)
+jnl=$(ls simulation_*.jnl 2> /dev/null | head -1)
+[ -n "$log" ] || fail "no log written"
+[ -n "$jnl" ] || fail "no journal written"
+
+./replay "$jnl" > replay.out 2>&1
+rc=$?
+cat replay.out
+[ $rc -eq 0 ] || fail "replay exited with $rc"
+
+violations=$(cat "$log" replay.out | grep -c VIOLATION)
+[ "$violations" -eq 0 ] || { grep VIOLATION "$log"; fail "$violations VIOLATION lines"; }
+grep -q "Audit: .* 0 violations" "$log" || fail "auditor did not report a clean run"
+
+if [ -n "$timeline" ]; then
+    for sig in signal1 signal2; do
+        if grep -q "^[^#]*$sig" "$timeline" && grep -q "$sig=0" replay.out; then
+            fail "$sig from the timeline never reached the journal"
+        fi
+    done
+fi
+if [ -n "${TRAM_EXPECT_LOG:-}" ]; then
+    grep -q "$TRAM_EXPECT_LOG" "$log" || fail "no log line matches '$TRAM_EXPECT_LOG'"
+fi
+if [ -n "${TRAM_EXPECT_ALL_DELIVERED:-}" ]; then
+    read -r done total < <(sed -n 's/^Delivered: *\([0-9]*\)\/\([0-9]*\)$/\1 \2/p' replay.out)
+    [ -n "${total:-}" ] && [ "$done" = "$total" ] || fail "not every rider was delivered (${done:-?}/${total:-?})"
+fi
+for kv in "$@"; do
+    if [[ $kv == DAYS=* ]]; then
+        grep -q "^Days: *${kv#DAYS=}$" replay.out || fail "journal does not cover ${kv#DAYS=} days"
+    fi
+done
+
+echo "PASS [$name]"